@@ -0,0 +1,86 @@
+#include "AffineLoopLowering.h"
+#include "ExprAnalysis.h"
+#include "ExprRewriter.h"
+
+#include <algorithm>
+#include <map>
+
+namespace {
+
+// Walks a loop body, accepting only constant pointer moves and additions. Additions of variables are loop
+// invariant, since the body cannot write to variables.
+class AffineBodyAnalysis : public ExprVisitor {
+private:
+    void visitDefault() override {
+        isAffine = false;
+    }
+public:
+    using ExprVisitor::visit;
+
+    bool isAffine = true;
+    int offset = 0;
+    std::map<int, char> constantAdds;
+    std::vector<std::pair<int, const Int8Expr*>> variableAdds;
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            e.accept(*this);
+        }
+    }
+
+    void visit(const MovePtrExpr& expr) override {
+        auto steps = getConstantValue(expr.getSteps());
+        if (!steps.has_value()) {
+            isAffine = false;
+            return;
+        }
+        offset += static_cast<signed char>(*steps);
+    }
+
+    void visit(const AddExpr& expr) override {
+        auto add = getConstantValue(expr.getAdd());
+        if (add.has_value()) {
+            constantAdds[offset] = static_cast<char>(constantAdds[offset] + *add);
+        } else {
+            variableAdds.emplace_back(offset, &expr.getAdd());
+        }
+    }
+};
+
+class AffineLoopLowering : public ExprRewriter {
+public:
+    using ExprRewriter::visit;
+
+    void visit(const LoopExpr& expr) override {
+        AffineBodyAnalysis analysis;
+        expr.getBody().accept(analysis);
+
+        auto loopCellStep = analysis.constantAdds[0];
+        bool isLowerable = analysis.isAffine
+                && analysis.offset == 0
+                && (loopCellStep == 1 || loopCellStep == -1)
+                && std::ranges::none_of(analysis.variableAdds, [](const auto& add) { return add.first == 0; });
+
+        if (!isLowerable) {
+            ExprRewriter::visit(expr);
+            return;
+        }
+
+        std::vector<AffineTerm> terms;
+        for (const auto& [offset, add] : analysis.constantAdds) {
+            if (offset != 0 && add != 0) {
+                terms.push_back({offset, mkInt8Expr<ConstInt8Expr>(add)});
+            }
+        }
+        for (const auto& [offset, add] : analysis.variableAdds) {
+            terms.push_back({offset, rewrite(*add)});
+        }
+        setResult(mkExpr<AffineLoopExpr>(loopCellStep, std::move(terms), expr.getLocation()));
+    }
+};
+
+}
+
+Expr lowerAffineLoops(const Expr& expr) {
+    return AffineLoopLowering{}.rewrite(expr);
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "Expr.h"
+
+// Replaces the loops equivalent to a sequence of multiply-adds with AffineLoopExpr.
+Expr lowerAffineLoops(const Expr& expr);
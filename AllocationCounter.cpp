@@ -0,0 +1,22 @@
+#include "CompileStats.h"
+
+#include <cstdlib>
+#include <new>
+
+// The rest of the global allocation functions end up here or in std::free.
+
+void* operator new(std::size_t size) {
+    AllocationCounter::allocations++;
+    AllocationCounter::bytes += size;
+    if (void* pointer = std::malloc(size == 0 ? 1 : size))
+        return pointer;
+    std::abort();
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
@@ -4,18 +4,82 @@
 
 #include "BFMachine.h"
 
+namespace {
+
+llvm::Value* getPageNumber(CompilerState* state, llvm::Value* index) {
+    return state->builder.CreateLShr(index, kTapePageBits, "page number");
+}
+
+llvm::Value* getPageOffset(CompilerState* state, llvm::Value* index) {
+    return state->builder.CreateAnd(index, (1 << kTapePageBits) - 1, "page offset");
+}
+
+}
+
 llvm::Value* BFMachine::getIndex() const {
     return state->builder.CreateLoad(pointer);
 }
 
+void BFMachine::setIndex(llvm::Value* newIndex) const {
+    auto& builder = state->builder;
+    builder.CreateStore(newIndex, pointer.pointer);
+    if (!pageCache.has_value())
+        return;
+
+    auto* pageNumber = getPageNumber(state, newIndex);
+    auto* isCached = builder.CreateICmpEQ(pageNumber, builder.CreateLoad(pageCache->number), "is the page cached");
+    auto* pageMissBB = state->createBasicBlock("page miss");
+    auto* afterPageMissBB = state->createBasicBlock("after page miss");
+    builder.CreateCondBr(isCached, afterPageMissBB, pageMissBB);
+
+    builder.SetInsertPoint(pageMissBB);
+    builder.CreateStore(generateCallGetPage(state, getTape(), pageNumber), pageCache->page.pointer);
+    builder.CreateStore(pageNumber, pageCache->number.pointer);
+    builder.CreateBr(afterPageMissBB);
+
+    builder.SetInsertPoint(afterPageMissBB);
+}
+
 llvm::Value* BFMachine::getCurrentChar() const {
+    if (pageCache.has_value())
+        return state->getCharArrayElement(state->builder.CreateLoad(pageCache->page),
+                                          getPageOffset(state, getIndex()));
     return state->getCharArrayElement(getTape(), getIndex());
 }
 
 void BFMachine::setCurrentChar(llvm::Value* theChar) const {
+    if (pageCache.has_value()) {
+        state->setCharArrayElement(state->builder.CreateLoad(pageCache->page), getPageOffset(state, getIndex()),
+                                   theChar);
+        return;
+    }
     state->setCharArrayElement(getTape(), getIndex(), theChar);
 }
 
+llvm::Value* BFMachine::getCharAt(llvm::Value* index) const {
+    if (pageCache.has_value())
+        return state->getCharArrayElement(generateCallGetPage(state, getTape(), getPageNumber(state, index)),
+                                          getPageOffset(state, index));
+    return state->getCharArrayElement(getTape(), index);
+}
+
+void BFMachine::setCharAt(llvm::Value* index, llvm::Value* theChar) const {
+    if (pageCache.has_value()) {
+        state->setCharArrayElement(generateCallGetPage(state, getTape(), getPageNumber(state, index)),
+                                   getPageOffset(state, index), theChar);
+        return;
+    }
+    state->setCharArrayElement(getTape(), index, theChar);
+}
+
+void BFMachine::generateFreeTape() const {
+    if (pageCache.has_value()) {
+        state->builder.CreateCall(state->module.getFunction("yabfpp.tape.free"), {getTape()});
+        return;
+    }
+    state->clib.generateCallFree(getTape());
+}
+
 llvm::Value* BFMachine::getTapeSize() const {
     return state->builder.CreateLoad(tapeSizePtr);
 }
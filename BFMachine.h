@@ -20,19 +20,33 @@
 #include "CLibHandler.h"
 #include "Pointer.h"
 
+#include <optional>
+
+// The page of the current cell of a paged tape, so that the cells are reached without a call while the pointer
+// stays on the page. Refreshed by setIndex.
+struct PageCache {
+    Pointer page;
+    Pointer number;
+};
+
 class BFMachine {
 public:
+    // The tape of a contiguous layout, the directory of a paged one, see TapeLayout.
     Pointer tapePtr;
     Pointer pointer;
     Pointer tapeSizePtr;
     CompilerState* const state;
     int initialTapeSize;
+    std::optional<PageCache> pageCache;
 
 
-    BFMachine(Pointer tapePtr, Pointer pointer, Pointer tapeSizePtr, CompilerState* state, int initialTapeSize) : tapePtr(tapePtr), pointer(pointer), tapeSizePtr(tapeSizePtr), state(state), initialTapeSize(initialTapeSize){}
+    BFMachine(Pointer tapePtr, Pointer pointer, Pointer tapeSizePtr, CompilerState* state, int initialTapeSize,
+              std::optional<PageCache> pageCache = std::nullopt) : tapePtr(tapePtr), pointer(pointer), tapeSizePtr(tapeSizePtr), state(state), initialTapeSize(initialTapeSize), pageCache(pageCache) {}
 
     [[nodiscard]] llvm::Value* getIndex() const;
 
+    void setIndex(llvm::Value* newIndex) const;
+
     [[nodiscard]] llvm::Value* getTape() const;
 
     void setTapePtr(llvm::Value* tape) const;
@@ -43,18 +57,44 @@ public:
 
     void setCurrentChar(llvm::Value* theChar) const;
 
+    // Any cell, not only the current one.
+    [[nodiscard]] llvm::Value* getCharAt(llvm::Value* index) const;
+
+    void setCharAt(llvm::Value* index, llvm::Value* theChar) const;
+
+    // A paged tape has no bounds to check, its pages are allocated on access.
     void generateCallTapeDoublingFunction(llvm::Value* newIndex) const {
+        if (pageCache.has_value())
+            return;
         std::vector<llvm::Value*> printArgs = {tapePtr.pointer, newIndex, tapeSizePtr.pointer};
-        state->builder.CreateCall(state->module.getFunction("doubleTapeIfNeeded"), printArgs);
+        state->builder.CreateCall(state->module.getFunction(state->getTapeDoublingFunctionName()), printArgs);
     }
+
+    void generateFreeTape() const;
 };
 
-inline BFMachine createBFMachine(CompilerState* state, int initialTapeSize) {
-    auto tape = state->clib.generateCallCalloc(state->getConstInt(initialTapeSize));
+inline llvm::Value* generateCallGetPage(CompilerState* state, llvm::Value* directory, llvm::Value* pageNumber) {
+    return state->builder.CreateCall(state->module.getFunction("yabfpp.tape.page"), {directory, pageNumber});
+}
 
+inline BFMachine createBFMachine(CompilerState* state, int initialTapeSize) {
     auto* int32ty = state->builder.getInt32Ty();
     auto pointer = state->allocateAndInitialize(int32ty, state->getConstInt(0));
     auto tapeSizePtr = state->allocateAndInitialize(int32ty, state->getConstInt(initialTapeSize));
+
+    if (state->getTapeLayout() == TapeLayout::Paged) {
+        // With the slot counting the used ones, see CompilerState::generatePagedTapeFunctions.
+        auto directory = state->clib.generateCallCalloc(state->getConstInt((1 << kTapeDirectoryBits) + 1));
+        auto tapePtr = state->allocateAndInitialize(state->getPtrTy(), directory);
+        PageCache pageCache{
+            state->allocateAndInitialize(state->getPtrTy(),
+                                         generateCallGetPage(state, directory, state->getConstInt(0))),
+            state->allocateAndInitialize(int32ty, state->getConstInt(0)),
+        };
+        return {tapePtr, pointer, tapeSizePtr, state, initialTapeSize, pageCache};
+    }
+
+    auto tape = state->clib.generateCallCalloc(state->getConstInt(initialTapeSize));
     auto tapePtr = state->allocateAndInitialize(state->getPtrTy(), tape);
 
     return {tapePtr, pointer, tapeSizePtr, state, initialTapeSize};
@@ -0,0 +1,127 @@
+#include "BoundsCheckHoisting.h"
+#include "ExprAnalysis.h"
+#include "ExprRewriter.h"
+
+#include <algorithm>
+
+namespace {
+
+// Follows the pointer through a loop body relative to where the body starts. Fails on the moves by variables and on
+// the nested loops and branches after which the offset is not known.
+class OffsetEnvelope : public ExprVisitor {
+private:
+    void visitDefault() override {
+        isKnown = false;
+    }
+
+    void reach(int cell) {
+        maxOffset = std::max(maxOffset, cell);
+    }
+
+    // The envelope of the nested body, which starts at the current offset.
+    OffsetEnvelope nested(const Expr& body) const {
+        OffsetEnvelope envelope;
+        body.accept(envelope);
+        envelope.offset += offset;
+        envelope.maxOffset += offset;
+        return envelope;
+    }
+public:
+    using ExprVisitor::visit;
+
+    bool isKnown = true;
+    int offset = 0;
+    int maxOffset = 0;
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            e.accept(*this);
+        }
+    }
+
+    void visit(const MovePtrExpr& expr) override {
+        auto steps = getConstantValue(expr.getSteps());
+        if (!steps.has_value()) {
+            isKnown = false;
+            return;
+        }
+        offset += static_cast<signed char>(*steps);
+        reach(offset);
+    }
+
+    // These only touch the current cell.
+    void visit(const AddExpr&) override {}
+    void visit(const ReadExpr&) override {}
+    void visit(const PrintExpr&) override {}
+    void visit(const PrintIntExpr&) override {}
+    void visit(const WriteToVariable&) override {}
+    void visit(const AssignExpressionValueToTheCurrentCell&) override {}
+    void visit(const Return&) override {}
+    // The function has a tape of its own.
+    void visit(const BFFunctionCall&) override {}
+
+    // Every iteration starts where the loop does only if the body is balanced.
+    void visit(const LoopExpr& expr) override {
+        auto body = nested(expr.getBody());
+        isKnown = isKnown && body.isKnown && body.offset == offset;
+        reach(body.maxOffset);
+    }
+
+    void visit(const AffineLoopExpr& expr) override {
+        for (const auto& term : expr.getTerms()) {
+            reach(offset + term.offset);
+        }
+    }
+
+    void visit(const IfElse& expr) override {
+        auto ifBranch = nested(expr.getIfExpr());
+        auto elseBranch = nested(expr.getElseExpr());
+        isKnown = isKnown && ifBranch.isKnown && elseBranch.isKnown && ifBranch.offset == elseBranch.offset;
+        offset = ifBranch.offset;
+        reach(std::max(ifBranch.maxOffset, elseBranch.maxOffset));
+    }
+};
+
+// Drops the checks of a body the enclosing loop checks for.
+class BoundsCheckRemoval : public ExprRewriter {
+public:
+    using ExprRewriter::visit;
+
+    void visit(const MovePtrExpr& expr) override {
+        setResult(mkExpr<MovePtrExpr>(rewrite(expr.getSteps()), expr.getLocation(), false));
+    }
+
+    void visit(const LoopExpr& expr) override {
+        setResult(mkExpr<LoopExpr>(rewrite(expr.getBody()), expr.getLocation()));
+    }
+
+    void visit(const AffineLoopExpr& expr) override {
+        std::vector<AffineTerm> terms;
+        for (const auto& term : expr.getTerms()) {
+            terms.push_back({term.offset, rewrite(term.coefficient)});
+        }
+        setResult(mkExpr<AffineLoopExpr>(expr.getStep(), std::move(terms), expr.getLocation(), false));
+    }
+};
+
+class BoundsCheckHoisting : public ExprRewriter {
+public:
+    using ExprRewriter::visit;
+
+    void visit(const LoopExpr& expr) override {
+        OffsetEnvelope envelope;
+        expr.getBody().accept(envelope);
+        if (!envelope.isKnown) {
+            ExprRewriter::visit(expr);
+            return;
+        }
+        HoistedBoundsCheck check{.perIteration = envelope.offset != 0, .maxOffset = envelope.maxOffset};
+        setResult(mkExpr<LoopExpr>(BoundsCheckRemoval{}.rewrite(expr.getBody()), expr.getLocation(), check));
+    }
+};
+
+}
+
+Expr hoistBoundsChecks(const Expr& expr) {
+    return BoundsCheckHoisting{}.rewrite(expr);
+}
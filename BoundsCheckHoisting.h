@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Expr.h"
+
+// Replaces the tape bounds checks of the pointer moves in a loop body with a single check per loop, where the body
+// only moves the pointer by constants so that the furthest cell it reaches is known. A body with zero net movement
+// is checked once before the loop, any other once per iteration. The moves, the affine loops and the nested loops
+// inside such a body are left unchecked.
+Expr hoistBoundsChecks(const Expr& expr);
@@ -0,0 +1,263 @@
+#include "Bytecode.h"
+#include "ExprAnalysis.h"
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// An int8 operand of an instruction: either a constant or a variable, possibly negated.
+struct Operand {
+    bool isVariable = false;
+    char value = 0;
+    char sign = 1;
+    int32_t slot = 0;
+};
+
+class OperandLowering : public ExprVisitor {
+private:
+    const ScopeLayout& layout;
+public:
+    using ExprVisitor::visit;
+
+    Operand operand;
+
+    explicit OperandLowering(const ScopeLayout& layout) : layout(layout) {}
+
+    void visit(const ConstInt8Expr& expr) override {
+        operand = {.value = expr.getValue()};
+    }
+
+    void visit(const VariableInt8Expr& expr) override {
+        operand = {.isVariable = true, .slot = layout.slots.at(expr.getName())};
+    }
+
+    void visit(const MinusInt8Expr& expr) override {
+        expr.getValue().accept(*this);
+        operand.value = static_cast<char>(-operand.value);
+        operand.sign = static_cast<char>(-operand.sign);
+    }
+};
+
+// Matches the loop bodies consisting of a single constant move, which turn the loop into a scan.
+class ScanMatcher : public ExprVisitor {
+public:
+    using ExprVisitor::visit;
+
+    std::optional<int32_t> steps;
+
+    void visit(const ListExpr& expr) override {
+        if (expr.getExprs().size() == 1) {
+            expr.getExprs().front().accept(*this);
+        }
+    }
+
+    void visit(const MovePtrExpr& expr) override {
+        if (auto value = getConstantValue(expr.getSteps())) {
+            steps = static_cast<int8_t>(*value);
+        }
+    }
+};
+
+class BytecodeLowering : public ExprVisitor {
+private:
+    std::vector<Instruction>& code;
+    const std::unordered_map<std::string, int32_t>& functionIndices;
+    const ScopeLayout* layout = nullptr;
+    // Jumps may land at this instruction, so it must not be merged into the one before it.
+    size_t mergeBarrier = 0;
+
+    int32_t emit(const Instruction& instruction) {
+        code.push_back(instruction);
+        return static_cast<int32_t>(code.size() - 1);
+    }
+
+    int32_t label() {
+        mergeBarrier = code.size();
+        return static_cast<int32_t>(code.size());
+    }
+
+    Instruction* getMergeCandidate() {
+        return code.size() > mergeBarrier ? &code.back() : nullptr;
+    }
+
+    Operand lowerOperand(const Int8Expr& expr) const {
+        OperandLowering lowering(*layout);
+        expr.accept(lowering);
+        return lowering.operand;
+    }
+
+    void emitAdd(char value) {
+        auto* last = getMergeCandidate();
+        if (last != nullptr && (last->opcode == Opcode::Add || last->opcode == Opcode::MoveAdd)) {
+            last->value = static_cast<char>(last->value + value);
+        } else if (last != nullptr && last->opcode == Opcode::Move) {
+            *last = {.opcode = Opcode::MoveAdd, .value = value, .operand = last->operand};
+        } else {
+            emit({.opcode = Opcode::Add, .value = value});
+        }
+    }
+
+    void emitMove(int32_t steps) {
+        auto* last = getMergeCandidate();
+        if (last != nullptr && (last->opcode == Opcode::Move || last->opcode == Opcode::AddMove)) {
+            last->operand += steps;
+        } else if (last != nullptr && last->opcode == Opcode::Add) {
+            *last = {.opcode = Opcode::AddMove, .value = last->value, .operand = steps};
+        } else {
+            emit({.opcode = Opcode::Move, .operand = steps});
+        }
+    }
+
+    void emitPrint() {
+        auto* last = getMergeCandidate();
+        if (last != nullptr && last->opcode == Opcode::Print) {
+            *last = {.opcode = Opcode::PrintRun, .operand = 2};
+        } else if (last != nullptr && last->opcode == Opcode::PrintRun) {
+            last->operand++;
+        } else {
+            emit({.opcode = Opcode::Print});
+        }
+    }
+
+public:
+    using ExprVisitor::visit;
+
+    BytecodeLowering(std::vector<Instruction>& code, const std::unordered_map<std::string, int32_t>& functionIndices)
+            : code(code), functionIndices(functionIndices) {}
+
+    int32_t lower(const Expr& body, const ScopeLayout& bodyLayout, Opcode terminator) {
+        layout = &bodyLayout;
+        int32_t entry = label();
+        body.accept(*this);
+        emit({.opcode = terminator});
+        return entry;
+    }
+
+    void visit(const MovePtrExpr& expr) override {
+        auto steps = lowerOperand(expr.getSteps());
+        if (steps.isVariable) {
+            emit({.opcode = Opcode::MoveVariable, .sign = steps.sign, .operand = steps.slot});
+        } else {
+            emitMove(static_cast<int8_t>(steps.value));
+        }
+    }
+
+    void visit(const AddExpr& expr) override {
+        auto add = lowerOperand(expr.getAdd());
+        if (add.isVariable) {
+            emit({.opcode = Opcode::AddVariable, .sign = add.sign, .operand = add.slot});
+        } else {
+            emitAdd(add.value);
+        }
+    }
+
+    void visit(const ReadExpr&) override { emit({.opcode = Opcode::Read}); }
+    void visit(const PrintExpr&) override { emitPrint(); }
+    void visit(const PrintIntExpr&) override { emit({.opcode = Opcode::PrintInt}); }
+
+    void visit(const LoopExpr& expr) override {
+        ScanMatcher matcher;
+        expr.getBody().accept(matcher);
+        if (matcher.steps.has_value()) {
+            emit({.opcode = Opcode::Scan, .operand = *matcher.steps});
+            return;
+        }
+        int32_t jumpToEnd = emit({.opcode = Opcode::JumpIfZero});
+        int32_t start = label();
+        expr.getBody().accept(*this);
+        emit({.opcode = Opcode::JumpIfNotZero, .operand = start});
+        code[jumpToEnd].operand = label();
+    }
+
+    void visit(const AffineLoopExpr& expr) override {
+        if (!expr.getTerms().empty()) {
+            int32_t maxOffset = 0;
+            for (const auto& term : expr.getTerms()) {
+                maxOffset = std::max(maxOffset, term.offset);
+            }
+            emit({.opcode = Opcode::Affine, .value = expr.getStep(), .operand = maxOffset});
+            for (const auto& term : expr.getTerms()) {
+                auto coefficient = lowerOperand(term.coefficient);
+                if (coefficient.isVariable) {
+                    emit({.opcode = Opcode::MulAddVariable, .sign = coefficient.sign, .operand = term.offset,
+                          .operand2 = coefficient.slot});
+                } else {
+                    emit({.opcode = Opcode::MulAdd, .value = coefficient.value, .operand = term.offset});
+                }
+            }
+        }
+        emit({.opcode = Opcode::Clear});
+    }
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            e.accept(*this);
+        }
+    }
+
+    void visit(const WriteToVariable& expr) override {
+        emit({.opcode = Opcode::Store, .operand = layout->slots.at(expr.getName())});
+    }
+
+    void visit(const AssignExpressionValueToTheCurrentCell& expr) override {
+        auto value = lowerOperand(expr.getValue());
+        if (value.isVariable) {
+            emit({.opcode = Opcode::AssignVariable, .sign = value.sign, .operand = value.slot});
+        } else {
+            emit({.opcode = Opcode::Assign, .value = value.value});
+        }
+    }
+
+    void visit(const IfElse& expr) override {
+        int32_t jumpToElse = emit({.opcode = Opcode::JumpIfZero});
+        expr.getIfExpr().accept(*this);
+        int32_t jumpToEnd = emit({.opcode = Opcode::Jump});
+        code[jumpToElse].operand = label();
+        expr.getElseExpr().accept(*this);
+        code[jumpToEnd].operand = label();
+    }
+
+    void visit(const Return&) override { emit({.opcode = Opcode::Return}); }
+
+    // The body is lowered separately after the main program.
+    void visit(const BFFunctionDeclaration&) override {}
+
+    void visit(const BFFunctionCall& expr) override {
+        for (const auto& argument : expr.getArguments()) {
+            auto value = lowerOperand(argument);
+            if (value.isVariable) {
+                emit({.opcode = Opcode::ArgumentVariable, .sign = value.sign, .operand = value.slot});
+            } else {
+                emit({.opcode = Opcode::Argument, .value = value.value});
+            }
+        }
+        emit({.opcode = Opcode::Call, .operand = functionIndices.at(expr.getFunctionName())});
+    }
+};
+
+}
+
+Bytecode lowerToBytecode(const Expr& program) {
+    Bytecode bytecode;
+    auto declarations = getFunctionDeclarations(program);
+    std::unordered_map<std::string, int32_t> functionIndices;
+    for (const auto* declaration : declarations) {
+        functionIndices.emplace(declaration->getFunctionName(), static_cast<int32_t>(functionIndices.size()));
+    }
+
+    BytecodeLowering lowering(bytecode.code, functionIndices);
+    ScopeLayout mainLayout = getScopeLayout({}, program);
+    lowering.lower(program, mainLayout, Opcode::Halt);
+    bytecode.variableCount = static_cast<int32_t>(mainLayout.names.size());
+
+    for (const auto* declaration : declarations) {
+        ScopeLayout layout = getScopeLayout(declaration->getArgumentNames(), declaration->getBody());
+        int32_t entry = lowering.lower(declaration->getBody(), layout, Opcode::Return);
+        bytecode.functions.push_back({entry, static_cast<int32_t>(declaration->getArgumentNames().size()),
+                                      static_cast<int32_t>(layout.names.size())});
+    }
+    return bytecode;
+}
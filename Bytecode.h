@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Expr.h"
+
+// The operands of an instruction are in value, operand and operand2; sign negates a variable operand, which is
+// read from the slot in operand (or operand2 for MulAddVariable).
+enum class Opcode : uint8_t {
+    Add,              // cell += value
+    AddVariable,      // cell += sign * variable
+    Move,             // index += operand
+    MoveVariable,     // index += sign * variable
+    AddMove,          // cell += value, index += operand
+    MoveAdd,          // index += operand, cell += value
+    Assign,           // cell = value
+    AssignVariable,   // cell = sign * variable
+    Store,            // variable = cell
+    Read,
+    Print,
+    PrintRun,         // prints the cell operand times
+    PrintInt,
+    Clear,            // cell = 0
+    Scan,             // index += operand while the cell is not 0
+    Jump,             // continues at operand
+    JumpIfZero,
+    JumpIfNotZero,
+    Affine,           // starts an affine loop with step value, operand is the largest offset of its terms
+    MulAdd,           // cell[index + operand] += value * iterations
+    MulAddVariable,   // cell[index + operand] += sign * variable * iterations
+    Argument,         // pushes value as the next argument of a call
+    ArgumentVariable, // pushes sign * variable as the next argument of a call
+    Call,             // calls the function number operand
+    Return,
+    Halt,
+};
+
+struct Instruction {
+    Opcode opcode;
+    char value = 0;
+    char sign = 1;
+    int32_t operand = 0;
+    int32_t operand2 = 0;
+};
+
+struct BytecodeFunction {
+    int32_t entry;
+    int32_t argumentCount;
+    int32_t variableCount;
+};
+
+// The main program starts at 0 and ends with Halt, the bodies of the functions follow it.
+struct Bytecode {
+    std::vector<Instruction> code;
+    std::vector<BytecodeFunction> functions;
+    int32_t variableCount = 0;
+};
+
+// Runs of adds, moves and prints are merged and the common idioms are lowered to superinstructions.
+Bytecode lowerToBytecode(const Expr& program);
@@ -0,0 +1,219 @@
+#include "BytecodeInterpreter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Computed gotos are a GNU extension, supported by both clang and gcc.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#ifdef __clang__
+#pragma clang diagnostic ignored "-Wgnu-label-as-value"
+#endif
+
+namespace {
+
+// Every instruction carries the address of its handler, so the dispatch is a single indirect jump.
+struct ThreadedInstruction {
+    const void* handler;
+    Instruction instruction;
+};
+
+struct Frame {
+    const ThreadedInstruction* returnAddress;
+    char* tape;
+    int32_t index;
+    int32_t tapeSize;
+    size_t variablesBase;
+};
+
+// Like doubleTapeIfNeeded, the tape grows far enough for the index in one go, as a merged move may jump further
+// than a single doubling covers. It stays a power of two times the initial size.
+int32_t getGrownTapeSize(int32_t tapeSize, int32_t index) {
+    int32_t newTapeSize = tapeSize * 2;
+    while (newTapeSize <= index) {
+        newTapeSize *= 2;
+    }
+    return newTapeSize;
+}
+
+char* resizeTape(char* tape, int32_t tapeSize, int32_t newTapeSize) {
+    auto* newTape = static_cast<char*>(std::realloc(tape, newTapeSize));
+    std::memset(newTape + tapeSize, 0, newTapeSize - tapeSize);
+    return newTape;
+}
+
+}
+
+int runBytecode(const Bytecode& bytecode, int initialTapeSize) {
+    // In the order of Opcode.
+    static const void* const handlers[] = {
+            &&add, &&addVariable, &&move, &&moveVariable, &&addMove, &&moveAdd, &&assign, &&assignVariable,
+            &&store, &&read, &&print, &&printRun, &&printInt, &&clear, &&scan, &&jump, &&jumpIfZero,
+            &&jumpIfNotZero, &&affine, &&mulAdd, &&mulAddVariable, &&argument, &&argumentVariable, &&call,
+            &&returnFromFunction, &&halt,
+    };
+
+    std::vector<ThreadedInstruction> program;
+    program.reserve(bytecode.code.size());
+    for (const auto& instruction : bytecode.code) {
+        program.push_back({handlers[static_cast<size_t>(instruction.opcode)], instruction});
+    }
+
+    std::vector<Frame> frames;
+    std::vector<char> variables(bytecode.variableCount);
+    std::vector<char> arguments;
+    size_t variablesBase = 0;
+    char* vars = variables.data();
+    auto* tape = static_cast<char*>(std::calloc(initialTapeSize, 1));
+    int32_t index = 0;
+    int32_t tapeSize = initialTapeSize;
+    char iterations = 0;
+    const ThreadedInstruction* ip = program.data();
+
+#define OPERAND (ip->instruction)
+#define VARIABLE(slot) static_cast<char>(OPERAND.sign * vars[slot])
+#define ENSURE_CAPACITY(i)                                                            \
+    if (static_cast<uint32_t>(i) >= static_cast<uint32_t>(tapeSize)) [[unlikely]] {  \
+        int32_t newTapeSize = getGrownTapeSize(tapeSize, i);                          \
+        tape = resizeTape(tape, tapeSize, newTapeSize);                               \
+        tapeSize = newTapeSize;                                                       \
+    }
+#define DISPATCH() goto *ip->handler
+#define NEXT() do { ++ip; DISPATCH(); } while (false)
+
+    DISPATCH();
+
+add:
+    tape[index] = static_cast<char>(tape[index] + OPERAND.value);
+    NEXT();
+addVariable:
+    tape[index] = static_cast<char>(tape[index] + VARIABLE(OPERAND.operand));
+    NEXT();
+move:
+    index += OPERAND.operand;
+    ENSURE_CAPACITY(index);
+    NEXT();
+moveVariable:
+    index += static_cast<int8_t>(VARIABLE(OPERAND.operand));
+    ENSURE_CAPACITY(index);
+    NEXT();
+addMove:
+    tape[index] = static_cast<char>(tape[index] + OPERAND.value);
+    index += OPERAND.operand;
+    ENSURE_CAPACITY(index);
+    NEXT();
+moveAdd:
+    index += OPERAND.operand;
+    ENSURE_CAPACITY(index);
+    tape[index] = static_cast<char>(tape[index] + OPERAND.value);
+    NEXT();
+assign:
+    tape[index] = OPERAND.value;
+    NEXT();
+assignVariable:
+    tape[index] = VARIABLE(OPERAND.operand);
+    NEXT();
+store:
+    vars[OPERAND.operand] = tape[index];
+    NEXT();
+read: {
+    int c = std::getchar();
+    tape[index] = c == EOF ? 0 : static_cast<char>(c);
+    NEXT();
+}
+print:
+    std::putchar(tape[index]);
+    NEXT();
+printRun:
+    for (int32_t i = 0; i < OPERAND.operand; i++) {
+        std::putchar(tape[index]);
+    }
+    NEXT();
+printInt:
+    std::printf("%d\n", static_cast<unsigned char>(tape[index]));
+    NEXT();
+clear:
+    tape[index] = 0;
+    NEXT();
+scan:
+    while (tape[index] != 0) {
+        index += OPERAND.operand;
+        ENSURE_CAPACITY(index);
+    }
+    NEXT();
+jump:
+    ip = program.data() + OPERAND.operand;
+    DISPATCH();
+jumpIfZero:
+    ip = tape[index] == 0 ? program.data() + OPERAND.operand : ip + 1;
+    DISPATCH();
+jumpIfNotZero:
+    ip = tape[index] != 0 ? program.data() + OPERAND.operand : ip + 1;
+    DISPATCH();
+affine:
+    if (OPERAND.operand > 0) {
+        ENSURE_CAPACITY(index + OPERAND.operand);
+    }
+    iterations = OPERAND.value == -1 ? tape[index] : static_cast<char>(-tape[index]);
+    NEXT();
+mulAdd:
+    tape[index + OPERAND.operand] = static_cast<char>(tape[index + OPERAND.operand] + OPERAND.value * iterations);
+    NEXT();
+mulAddVariable:
+    tape[index + OPERAND.operand] = static_cast<char>(tape[index + OPERAND.operand] +
+                                                      VARIABLE(OPERAND.operand2) * iterations);
+    NEXT();
+argument:
+    arguments.push_back(OPERAND.value);
+    NEXT();
+argumentVariable:
+    arguments.push_back(VARIABLE(OPERAND.operand));
+    NEXT();
+call: {
+    const auto& function = bytecode.functions[OPERAND.operand];
+    frames.push_back({ip + 1, tape, index, tapeSize, variablesBase});
+    variablesBase = variables.size();
+    variables.resize(variablesBase + function.variableCount);
+    vars = variables.data() + variablesBase;
+    std::copy_n(arguments.begin(), function.argumentCount, vars);
+    arguments.clear();
+    tape = static_cast<char*>(std::calloc(initialTapeSize, 1));
+    index = 0;
+    tapeSize = initialTapeSize;
+    ip = program.data() + function.entry;
+    DISPATCH();
+}
+returnFromFunction: {
+    // A return from the main program ends it.
+    if (frames.empty())
+        goto halt;
+    char result = tape[index];
+    std::free(tape);
+    variables.resize(variablesBase);
+    const Frame& frame = frames.back();
+    ip = frame.returnAddress;
+    tape = frame.tape;
+    index = frame.index;
+    tapeSize = frame.tapeSize;
+    variablesBase = frame.variablesBase;
+    vars = variables.data() + variablesBase;
+    frames.pop_back();
+    tape[index] = result;
+    DISPATCH();
+}
+halt:
+    std::free(tape);
+    std::fflush(stdout);
+    return 0;
+
+#undef NEXT
+#undef DISPATCH
+#undef ENSURE_CAPACITY
+#undef VARIABLE
+#undef OPERAND
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "Bytecode.h"
+
+// Runs the bytecode with a direct-threaded interpreter. The tape, the I/O and the functions behave the same way
+// as in the compiled program.
+int runBytecode(const Bytecode& bytecode, int initialTapeSize);
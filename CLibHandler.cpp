@@ -14,7 +14,8 @@ void CLibHandler::generatePrintfInt() const {
 
 void CLibHandler::generateCallPrintfInt(llvm::Value* theInt) const {
     llvm::Value* formatStr = builder->CreateGlobalString("%d\n");
-    std::vector<llvm::Value*> printArgs = {formatStr, theInt};
+    // A variadic argument is promoted to int. The cell is printed as unsigned, like the interpreters do.
+    std::vector<llvm::Value*> printArgs = {formatStr, builder->CreateZExt(theInt, builder->getInt32Ty())};
     builder->CreateCall(module->getFunction("printf"), printArgs);
 }
 
@@ -38,8 +39,8 @@ llvm::Value* CLibHandler::generateCallGetChar() const {
 }
 
 
-llvm::Value* CLibHandler::generateCallCalloc(llvm::Value* size) const {
-    return builder->CreateCall(module->getFunction("calloc"), {size, getConstInt(8)});
+llvm::Value* CLibHandler::generateCallCalloc(llvm::Value* count, int elementSize) const {
+    return builder->CreateCall(module->getFunction("calloc"), {count, getConstInt(elementSize)});
 }
 
 void CLibHandler::generateCalloc() const {
@@ -49,15 +50,15 @@ void CLibHandler::generateCalloc() const {
                     "calloc");
 }
 
-void CLibHandler::generateMemcpy() const {
-    declareFunction({getPtrTy(), getPtrTy(), builder->getInt32Ty()},
+void CLibHandler::generateRealloc() const {
+    declareFunction({getPtrTy(), getSizeTy()},
                     getPtrTy(),
                     false,
-                    "memcpy");
+                    "realloc");
 }
 
-void CLibHandler::generateCallMemcpy(llvm::Value* dest, llvm::Value* src, llvm::Value* size) const {
-    builder->CreateCall(module->getFunction("memcpy"), {dest, src, size});
+llvm::Value* CLibHandler::generateCallRealloc(llvm::Value* ptr, llvm::Value* size) const {
+    return builder->CreateCall(module->getFunction("realloc"), {ptr, size});
 }
 
 
@@ -84,6 +85,6 @@ void CLibHandler::init() const {
     generateCalloc();
     generateFree();
     generateGetChar();
-    generateMemcpy();
+    generateRealloc();
 }
 
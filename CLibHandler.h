@@ -7,6 +7,7 @@
 
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/TargetParser/Triple.h"
 #include "ConstantHelper.h"
 
 class CLibHandler : ConstantHelper {
@@ -25,12 +26,17 @@ private:
 
     void generateGetChar() const;
 
-    void generateMemcpy() const;
+    void generateRealloc() const;
 
     auto* getPtrTy() const {
         return llvm::PointerType::get(module->getContext(), 0);
     }
 public:
+    // size_t of the target.
+    [[nodiscard]] llvm::IntegerType* getSizeTy() const {
+        return llvm::Triple(module->getTargetTriple()).isArch32Bit() ? builder->getInt32Ty() : builder->getInt64Ty();
+    }
+
     void init() const;
 
 
@@ -47,9 +53,9 @@ public:
 
     void generateCallPrintfInt(llvm::Value* theInt) const;
 
-    void generateCallMemcpy(llvm::Value* dest, llvm::Value* src, llvm::Value* size) const;
+    llvm::Value* generateCallRealloc(llvm::Value* ptr, llvm::Value* size) const;
 
-    llvm::Value* generateCallCalloc(llvm::Value* size) const;
+    llvm::Value* generateCallCalloc(llvm::Value* count, int elementSize = 8) const;
 
     [[nodiscard]] llvm::Value* generateCallGetChar() const;
 };
@@ -0,0 +1,221 @@
+#include "CallEvaluator.h"
+#include "ExprAnalysis.h"
+
+#include <ranges>
+
+namespace {
+
+// What a call evaluated at compile time may take, counted in the nodes it runs.
+constexpr uint64_t kStepBudget = uint64_t{1} << 20;
+// How deep the calls may nest, so that a deep recursion does not overflow the stack of the compiler.
+constexpr int kMaxDepth = 256;
+// How far right the pointer may move.
+constexpr int kMaxTapeSize = 1 << 20;
+
+}
+
+// Runs a function body over a tape, the way the generated code does. Stops at the first construct it cannot run at
+// compile time.
+class CallEvaluator::Evaluation : public ExprVisitor {
+private:
+    CallEvaluator& evaluator;
+    uint64_t& steps;
+    int depth;
+    std::vector<char> tape = std::vector<char>(1);
+    int index = 0;
+    std::map<std::string, char> variables;
+    // The value of the Int8Expr visited last.
+    std::optional<char> value;
+
+    bool step() {
+        if (++steps > kStepBudget) {
+            failed = true;
+            isOutOfLimits = true;
+        }
+        return !isStopped();
+    }
+
+    std::optional<char> evaluateValue(const Int8Expr& expr) {
+        value.reset();
+        expr.accept(*this);
+        if (!value.has_value())
+            failed = true;
+        return value;
+    }
+
+    char& cell(int cellIndex) {
+        if (cellIndex >= static_cast<int>(tape.size()))
+            tape.resize(cellIndex + 1);
+        return tape[cellIndex];
+    }
+
+    bool isOnTape(int cellIndex) {
+        if (cellIndex < 0 || cellIndex >= kMaxTapeSize)
+            failed = true;
+        return !failed;
+    }
+public:
+    using ExprVisitor::visit;
+
+    bool failed = false;
+    // Whether it failed on the limits rather than on the code, see Failure.
+    bool isOutOfLimits = false;
+    bool hasReturned = false;
+
+    Evaluation(CallEvaluator& evaluator, uint64_t& steps, int depth) : evaluator(evaluator), steps(steps), depth(depth) {}
+
+    void setVariable(const std::string& name, char variableValue) { variables[name] = variableValue; }
+
+    [[nodiscard]] bool isStopped() const { return failed || hasReturned; }
+
+    [[nodiscard]] char getCurrentCell() const { return tape[index]; }
+
+    // I/O cannot happen at compile time.
+    void visitDefault() override { failed = true; }
+
+    void visit(const MinusInt8Expr& expr) override {
+        expr.getValue().accept(*this);
+        if (value.has_value())
+            value = static_cast<char>(-*value);
+    }
+
+    void visit(const VariableInt8Expr& expr) override {
+        auto it = variables.find(expr.getName());
+        if (it != variables.end())
+            value = it->second;
+    }
+
+    void visit(const ConstInt8Expr& expr) override { value = expr.getValue(); }
+
+    void visit(const MovePtrExpr& expr) override {
+        auto move = evaluateValue(expr.getSteps());
+        if (!step() || !move.has_value())
+            return;
+        // The steps are sign extended, whatever the signedness of char.
+        if (isOnTape(index + static_cast<signed char>(*move))) {
+            index += static_cast<signed char>(*move);
+            cell(index);
+        }
+    }
+
+    void visit(const AddExpr& expr) override {
+        auto add = evaluateValue(expr.getAdd());
+        if (step() && add.has_value())
+            cell(index) = static_cast<char>(cell(index) + *add);
+    }
+
+    void visit(const LoopExpr& expr) override {
+        while (step() && cell(index) != 0) {
+            expr.getBody().accept(*this);
+        }
+    }
+
+    void visit(const AffineLoopExpr& expr) override {
+        if (!step())
+            return;
+        auto iterations = static_cast<char>(expr.getStep() == -1 ? cell(index) : -cell(index));
+        for (const auto& term : expr.getTerms()) {
+            auto coefficient = evaluateValue(term.coefficient);
+            if (!coefficient.has_value() || !isOnTape(index + term.offset))
+                return;
+            auto& termCell = cell(index + term.offset);
+            termCell = static_cast<char>(termCell + *coefficient * iterations);
+        }
+        cell(index) = 0;
+    }
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            if (!step())
+                return;
+            e.accept(*this);
+        }
+    }
+
+    void visit(const WriteToVariable& expr) override {
+        if (step())
+            variables[expr.getName()] = cell(index);
+    }
+
+    void visit(const AssignExpressionValueToTheCurrentCell& expr) override {
+        auto assigned = evaluateValue(expr.getValue());
+        if (step() && assigned.has_value())
+            cell(index) = *assigned;
+    }
+
+    void visit(const IfElse& expr) override {
+        if (step())
+            (cell(index) != 0 ? expr.getIfExpr() : expr.getElseExpr()).accept(*this);
+    }
+
+    void visit(const Return&) override {
+        if (step())
+            hasReturned = true;
+    }
+
+    // Generated wherever it is, it does nothing where it appears.
+    void visit(const BFFunctionDeclaration&) override { step(); }
+
+    void visit(const BFFunctionCall& expr) override {
+        std::vector<char> arguments;
+        for (const auto& argument : expr.getArguments()) {
+            auto argumentValue = evaluateValue(argument);
+            if (!argumentValue.has_value())
+                return;
+            arguments.push_back(*argumentValue);
+        }
+        if (!step())
+            return;
+        auto result = evaluator.evaluate(expr.getFunctionName(), arguments, steps, depth + 1);
+        if (result.has_value()) {
+            cell(index) = *result;
+        } else {
+            failed = true;
+            isOutOfLimits = result.error() == Failure::OutOfLimits;
+        }
+    }
+};
+
+CallEvaluator::CallEvaluator(const Expr& program) {
+    for (const auto* declaration : getFunctionDeclarations(program)) {
+        functions.emplace(declaration->getFunctionName(), declaration);
+    }
+}
+
+std::optional<char> CallEvaluator::evaluate(const std::string& functionName, const std::vector<char>& arguments) {
+    uint64_t steps = 0;
+    auto result = evaluate(functionName, arguments, steps, 0);
+    if (!result.has_value())
+        return std::nullopt;
+    return *result;
+}
+
+std::expected<char, CallEvaluator::Failure> CallEvaluator::evaluate(const std::string& functionName,
+                                                                    const std::vector<char>& arguments,
+                                                                    uint64_t& steps, int depth) {
+    auto key = std::pair(functionName, arguments);
+    if (auto it = results.find(key); it != results.end())
+        return it->second;
+    auto function = functions.find(functionName);
+    if (function == functions.end())
+        return std::unexpected(Failure::Unevaluable);
+    if (depth > kMaxDepth)
+        return std::unexpected(Failure::OutOfLimits);
+
+    // Had the call all the limits to itself, more could not be given to it.
+    bool hasAllLimits = depth == 0 && steps == 0;
+    const auto& declaration = *function->second;
+    Evaluation evaluation(*this, steps, depth);
+    for (const auto& [name, argument] : std::views::zip(declaration.getArgumentNames(), arguments)) {
+        evaluation.setVariable(name, argument);
+    }
+    declaration.getBody().accept(evaluation);
+    std::expected<char, Failure> result = evaluation.getCurrentCell();
+    if (evaluation.isOutOfLimits)
+        result = std::unexpected(Failure::OutOfLimits);
+    else if (evaluation.failed)
+        result = std::unexpected(Failure::Unevaluable);
+    if (result.has_value() || result.error() == Failure::Unevaluable || hasAllLimits)
+        results.emplace(std::move(key), result);
+    return result;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Expr.h"
+
+// Runs the calls of the functions of a program at compile time. A function is run on a tape of its own as the
+// generated code would run it, together with the functions it calls, and the results are remembered for the whole
+// compilation. Holds on to the declarations, so the program must outlive it.
+class CallEvaluator {
+private:
+    class Evaluation;
+
+    enum class Failure {
+        // The call does I/O, reads an unknown variable or leaves the tape, however it is evaluated.
+        Unevaluable,
+        // The call ran out of the steps or of the nesting left to it, and may succeed with more.
+        OutOfLimits,
+    };
+
+    // The calls resolve to the first declaration of the name.
+    std::map<std::string, const BFFunctionDeclaration*> functions;
+    // Only what does not depend on the limits, so that the outcome does not depend on where a call was evaluated
+    // first. A call which ran out of the limits is remembered only if it had all of them.
+    std::map<std::pair<std::string, std::vector<char>>, std::expected<char, Failure>> results;
+
+    // The steps are counted over the whole call being evaluated, including the calls nested in it.
+    std::expected<char, Failure> evaluate(const std::string& functionName, const std::vector<char>& arguments,
+                                          uint64_t& steps, int depth);
+public:
+    explicit CallEvaluator(const Expr& program);
+
+    // The value the call returns, or std::nullopt if the function or any function it calls does I/O, reads a
+    // variable before writing it, moves the pointer left of the start of the tape or takes too long to run.
+    std::optional<char> evaluate(const std::string& functionName, const std::vector<char>& arguments);
+};
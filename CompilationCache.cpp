@@ -0,0 +1,163 @@
+#include "CompilationCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Bump whenever the emitted IR changes for the same input, so that the stale artefacts are never served.
+constexpr std::string_view kCacheFormatVersion = "13";
+
+constexpr std::string_view kTemporaryExtension = ".tmp";
+
+// Temporary files this old were left behind by a compiler that died before renaming them.
+constexpr auto kAbandonedTemporaryAge = std::chrono::hours(1);
+
+}
+
+std::string getCacheKey(const Source& src, const std::vector<std::string>& options, bool withLocations) {
+    llvm::SHA256 hasher;
+    auto addField = [&](std::string_view field) {
+        hasher.update(llvm::StringRef(field.data(), field.size()));
+        hasher.update(llvm::StringRef("\0", 1));
+    };
+    addField(kCacheFormatVersion);
+    addField(LLVM_VERSION_STRING);
+    addField(std::string(src.begin(), src.end()));
+    if (withLocations) {
+        std::string locations;
+        for (auto i = src.begin(); !i.isEnd(); ++i) {
+            locations += std::to_string(i.getLine()) + ":" + std::to_string(i.getLinePosition()) + " ";
+        }
+        addField(locations);
+    }
+    for (const auto& option : options) {
+        addField(option);
+    }
+    return llvm::toHex(hasher.final(), /*LowerCase=*/true);
+}
+
+CompilationCache::CompilationCache(fs::path directory, uintmax_t maxSize)
+        : directory(std::move(directory)), maxSize(maxSize) {}
+
+fs::path CompilationCache::getEntryPath(const std::string& name) const {
+    return directory / name;
+}
+
+fs::path CompilationCache::createTemporaryPath(const std::string& name) const {
+    std::error_code error;
+    fs::create_directories(directory, error);
+    std::random_device random;
+    return directory / (name + "." + std::to_string(random()) + std::string(kTemporaryExtension));
+}
+
+void CompilationCache::publish(const fs::path& temporaryPath, const std::string& name) const {
+    std::error_code error;
+    fs::rename(temporaryPath, getEntryPath(name), error);
+    if (error) {
+        fs::remove(temporaryPath, error);
+        return;
+    }
+    evict();
+}
+
+// The modification time is what the eviction orders by.
+void CompilationCache::touch(const std::string& name) const {
+    std::error_code error;
+    fs::last_write_time(getEntryPath(name), fs::file_time_type::clock::now(), error);
+}
+
+bool CompilationCache::fetch(const std::string& name, const fs::path& outputPath) const {
+    std::error_code error;
+    if (!fs::copy_file(getEntryPath(name), outputPath, fs::copy_options::overwrite_existing, error))
+        return false;
+    touch(name);
+    return true;
+}
+
+std::unique_ptr<llvm::MemoryBuffer> CompilationCache::load(const std::string& name) const {
+    auto buffer = llvm::MemoryBuffer::getFile(getEntryPath(name).string());
+    if (!buffer)
+        return nullptr;
+    touch(name);
+    return std::move(*buffer);
+}
+
+void CompilationCache::storeFile(const std::string& name, const fs::path& artefactPath) const {
+    std::error_code error;
+    auto temporaryPath = createTemporaryPath(name);
+    if (!fs::copy_file(artefactPath, temporaryPath, error)) {
+        fs::remove(temporaryPath, error);
+        return;
+    }
+    publish(temporaryPath, name);
+}
+
+void CompilationCache::store(const std::string& name, llvm::StringRef contents) const {
+    auto temporaryPath = createTemporaryPath(name);
+    {
+        std::error_code error;
+        llvm::raw_fd_ostream out(temporaryPath.string(), error);
+        if (error)
+            return;
+        out << contents;
+        out.close();
+        if (out.has_error()) {
+            out.clear_error();
+            fs::remove(temporaryPath, error);
+            return;
+        }
+    }
+    publish(temporaryPath, name);
+}
+
+void CompilationCache::evict() const {
+    struct Entry {
+        fs::path path;
+        uintmax_t size;
+        fs::file_time_type lastUse;
+    };
+
+    std::error_code error;
+    auto now = fs::file_time_type::clock::now();
+    std::vector<Entry> entries;
+    uintmax_t totalSize = 0;
+    for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        std::error_code fileError;
+        auto lastUse = it->last_write_time(fileError);
+        if (fileError)
+            continue;
+        if (it->path().extension() == kTemporaryExtension) {
+            if (now - lastUse > kAbandonedTemporaryAge)
+                fs::remove(it->path(), fileError);
+            continue;
+        }
+        auto size = it->file_size(fileError);
+        if (fileError)
+            continue;
+        entries.push_back({it->path(), size, lastUse});
+        totalSize += size;
+    }
+
+    if (totalSize <= maxSize)
+        return;
+    std::ranges::sort(entries, {}, &Entry::lastUse);
+    for (const auto& entry : entries) {
+        if (totalSize <= maxSize)
+            break;
+        // Another compiler may have evicted it already, the size is gone either way.
+        fs::remove(entry.path, error);
+        totalSize -= entry.size;
+    }
+}
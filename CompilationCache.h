@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Source.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+// Hashes the source as the parser sees it, i.e. without comments and skipped characters, together with the options
+// the emitted IR depends on. With withLocations the line and column of every character are hashed too, for the IR
+// which refers to the positions in the source: the profile counters, the branch weights and the line tables.
+std::string getCacheKey(const Source& src, const std::vector<std::string>& options, bool withLocations = false);
+
+// A directory of emitted artefacts, each named by its key and an extension telling the kind of the artefact.
+// Any number of compilers may share it: the artefacts are published with an atomic rename, so a reader sees
+// either a complete file or none. Once the directory outgrows maxSize, the least recently used artefacts are evicted.
+class CompilationCache {
+private:
+    std::filesystem::path directory;
+    uintmax_t maxSize;
+
+    [[nodiscard]] std::filesystem::path getEntryPath(const std::string& name) const;
+
+    [[nodiscard]] std::filesystem::path createTemporaryPath(const std::string& name) const;
+
+    void publish(const std::filesystem::path& temporaryPath, const std::string& name) const;
+
+    void touch(const std::string& name) const;
+
+    void evict() const;
+public:
+    CompilationCache(std::filesystem::path directory, uintmax_t maxSize);
+
+    // Copies the artefact to outputPath. Returns false on a miss.
+    bool fetch(const std::string& name, const std::filesystem::path& outputPath) const;
+
+    // Returns nullptr on a miss.
+    [[nodiscard]] std::unique_ptr<llvm::MemoryBuffer> load(const std::string& name) const;
+
+    void storeFile(const std::string& name, const std::filesystem::path& artefactPath) const;
+
+    void store(const std::string& name, llvm::StringRef contents) const;
+};
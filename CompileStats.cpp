@@ -0,0 +1,178 @@
+#include "CompileStats.h"
+
+#include <algorithm>
+#include <print>
+
+#include <sys/resource.h>
+
+#include "llvm/IR/InstIterator.h"
+
+thread_local uint64_t AllocationCounter::allocations = 0;
+thread_local uint64_t AllocationCounter::bytes = 0;
+
+namespace {
+
+constexpr std::string_view kRuntime = "(runtime)";
+
+long getPeakRSSKiB() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+}
+
+void ExprKindNamer::visit(const MinusInt8Expr&) { kind = "MinusInt8Expr"; }
+void ExprKindNamer::visit(const VariableInt8Expr&) { kind = "VariableInt8Expr"; }
+void ExprKindNamer::visit(const ConstInt8Expr&) { kind = "ConstInt8Expr"; }
+void ExprKindNamer::visit(const MovePtrExpr&) { kind = "MovePtrExpr"; }
+void ExprKindNamer::visit(const AddExpr&) { kind = "AddExpr"; }
+void ExprKindNamer::visit(const ReadExpr&) { kind = "ReadExpr"; }
+void ExprKindNamer::visit(const PrintExpr&) { kind = "PrintExpr"; }
+void ExprKindNamer::visit(const PrintIntExpr&) { kind = "PrintIntExpr"; }
+void ExprKindNamer::visit(const LoopExpr&) { kind = "LoopExpr"; }
+void ExprKindNamer::visit(const AffineLoopExpr&) { kind = "AffineLoopExpr"; }
+void ExprKindNamer::visit(const ListExpr&) { kind = "ListExpr"; }
+void ExprKindNamer::visit(const WriteToVariable&) { kind = "WriteToVariable"; }
+void ExprKindNamer::visit(const AssignExpressionValueToTheCurrentCell&) { kind = "AssignExpressionValueToTheCurrentCell"; }
+void ExprKindNamer::visit(const IfElse&) { kind = "IfElse"; }
+void ExprKindNamer::visit(const Return&) { kind = "Return"; }
+void ExprKindNamer::visit(const BFFunctionDeclaration&) { kind = "BFFunctionDeclaration"; }
+void ExprKindNamer::visit(const BFFunctionCall&) { kind = "BFFunctionCall"; }
+
+void CompileStats::countSource(const std::vector<std::string>& lines) {
+    sourceBytes = lines.capacity() * sizeof(std::string);
+    for (const auto& line : lines) {
+        sourceBytes += line.capacity();
+    }
+}
+
+void CompileStats::countAST(std::string_view stage, NodeCounts counts) {
+    astCounts.emplace_back(std::string(stage), std::move(counts));
+}
+
+void CompileStats::countDeadCode(std::string_view kind) {
+    auto it = deadCode.find(kind);
+    if (it == deadCode.end())
+        it = deadCode.emplace(std::string(kind), 0).first;
+    it->second++;
+}
+
+void CompileStats::startCodeGeneration(llvm::IRBuilderBase& irBuilder, const llvm::Module& module) {
+    builder = &irBuilder;
+    constructKind = module.getContext().getMDKindID("yabfpp.construct");
+    // Whatever is there before the program is generated is the runtime.
+    auto& runtime = irSizes[std::string(kRuntime)];
+    for (const auto& function : module) {
+        runtime.basicBlocks += function.size();
+    }
+}
+
+void CompileStats::tagInstructions() {
+    builder->AddOrRemoveMetadataToCopy(constructKind, constructs.empty() ? nullptr : constructs.back());
+}
+
+void CompileStats::enterConstruct(std::string_view kind) {
+    if (builder == nullptr)
+        return;
+    auto& context = builder->getContext();
+    constructs.push_back(llvm::MDNode::get(context, llvm::MDString::get(context, kind)));
+    tagInstructions();
+}
+
+void CompileStats::exitConstruct() {
+    if (builder == nullptr)
+        return;
+    constructs.pop_back();
+    tagInstructions();
+}
+
+void CompileStats::countBasicBlock() {
+    if (builder == nullptr || constructs.empty())
+        return;
+    std::string_view kind = llvm::cast<llvm::MDString>(constructs.back()->getOperand(0))->getString();
+    auto it = irSizes.find(kind);
+    if (it == irSizes.end())
+        it = irSizes.emplace(std::string(kind), IRSize{}).first;
+    it->second.basicBlocks++;
+}
+
+void CompileStats::countIR(llvm::Module& module) {
+    for (auto& function : module) {
+        for (auto& instruction : llvm::instructions(function)) {
+            auto* construct = instruction.getMetadata(constructKind);
+            std::string_view kind = kRuntime;
+            if (construct != nullptr)
+                kind = llvm::cast<llvm::MDString>(construct->getOperand(0))->getString();
+            auto it = irSizes.find(kind);
+            if (it == irSizes.end())
+                it = irSizes.emplace(std::string(kind), IRSize{}).first;
+            it->second.instructions++;
+            instruction.setMetadata(constructKind, nullptr);
+        }
+    }
+    if (builder != nullptr)
+        builder->AddOrRemoveMetadataToCopy(constructKind, nullptr);
+    builder = nullptr;
+
+    // Named after the growth policy, see CompilerState::getTapeDoublingFunctionName.
+    for (const auto& function : module) {
+        if (!function.getName().starts_with("doubleTapeIfNeeded."))
+            continue;
+        tapeDoublingCalls += std::ranges::count_if(function.users(), [](const llvm::User* user) {
+            return llvm::isa<llvm::CallInst>(user);
+        });
+    }
+}
+
+void CompileStats::print() const {
+    std::println("Statistics for {}", source);
+    std::println("{:>12} bytes held by the source lines", sourceBytes);
+
+    std::println("{:>12} {:>12} {:>12}  {}", "allocations", "bytes", "peak RSS KiB", "phase");
+    for (const auto& phase : phases) {
+        std::println("{:>12} {:>12} {:>12}  {}{}", phase.allocations, phase.allocatedBytes, phase.peakRSSKiB,
+                     std::string(2 * phase.depth, ' '), phase.name);
+    }
+
+    for (const auto& [stage, counts] : astCounts) {
+        std::println("{:>12}  AST nodes {}", "count", stage);
+        for (const auto& [kind, count] : counts) {
+            std::println("{:>12}  {}", count, kind);
+        }
+    }
+
+    for (const auto& [kind, count] : deadCode) {
+        std::println("{:>12}  dead {} removed", count, kind);
+    }
+
+    if (irSizes.empty())
+        return;
+    std::println("{:>12} {:>12}  {}", "instructions", "blocks", "construct");
+    for (const auto& [kind, size] : irSizes) {
+        std::println("{:>12} {:>12}  {}", size.instructions, size.basicBlocks, kind);
+    }
+    std::println("{:>12} doubleTapeIfNeeded call sites", tapeDoublingCalls);
+}
+
+StatsRegion::StatsRegion(CompileStats* stats, std::string_view name) : stats(stats) {
+    if (stats == nullptr)
+        return;
+    auto it = std::ranges::find(stats->phases, name, &CompileStats::Phase::name);
+    phase = it - stats->phases.begin();
+    if (it == stats->phases.end())
+        stats->phases.push_back({std::string(name), stats->depth});
+    stats->depth++;
+    allocations = AllocationCounter::allocations;
+    allocatedBytes = AllocationCounter::bytes;
+}
+
+StatsRegion::~StatsRegion() {
+    if (stats == nullptr)
+        return;
+    auto& entry = stats->phases[phase];
+    entry.allocations += AllocationCounter::allocations - allocations;
+    entry.allocatedBytes += AllocationCounter::bytes - allocatedBytes;
+    entry.peakRSSKiB = std::max(entry.peakRSSKiB, getPeakRSSKiB());
+    stats->depth--;
+}
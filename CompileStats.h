@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ExprVisitor.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+
+// Counted by the replacement of the global operator new, which only the compiler links. Stay zero elsewhere.
+struct AllocationCounter {
+    static thread_local uint64_t allocations;
+    static thread_local uint64_t bytes;
+};
+
+// Names the node types in the statistics.
+class ExprKindNamer : public ExprVisitor {
+public:
+    using ExprVisitor::visit;
+
+    std::string_view kind;
+
+    void visit(const MinusInt8Expr&) override;
+    void visit(const VariableInt8Expr&) override;
+    void visit(const ConstInt8Expr&) override;
+    void visit(const MovePtrExpr&) override;
+    void visit(const AddExpr&) override;
+    void visit(const ReadExpr&) override;
+    void visit(const PrintExpr&) override;
+    void visit(const PrintIntExpr&) override;
+    void visit(const LoopExpr&) override;
+    void visit(const AffineLoopExpr&) override;
+    void visit(const ListExpr&) override;
+    void visit(const WriteToVariable&) override;
+    void visit(const AssignExpressionValueToTheCurrentCell&) override;
+    void visit(const IfElse&) override;
+    void visit(const Return&) override;
+    void visit(const BFFunctionDeclaration&) override;
+    void visit(const BFFunctionCall&) override;
+};
+
+// The number of the nodes of every kind in a tree.
+using NodeCounts = std::map<std::string, uint64_t, std::less<>>;
+
+template <typename T>
+std::string_view getExprKind(const T& expr) {
+    ExprKindNamer namer;
+    namer.visit(expr);
+    return namer.kind;
+}
+
+// What compiling a single source costs in memory and in the size of the IR. The allocations are counted on the
+// thread compiling the source, while the peak RSS is that of the whole process.
+class CompileStats {
+private:
+    struct Phase {
+        std::string name;
+        int depth;
+        uint64_t allocations = 0;
+        uint64_t allocatedBytes = 0;
+        long peakRSSKiB = 0;
+    };
+
+    struct IRSize {
+        uint64_t instructions = 0;
+        uint64_t basicBlocks = 0;
+    };
+
+    std::string source;
+    std::vector<Phase> phases;
+    int depth = 0;
+    uint64_t sourceBytes = 0;
+    // The AST is counted when parsed and when optimized.
+    std::vector<std::pair<std::string, NodeCounts>> astCounts;
+    // The number of constructs of every kind the dead-code elimination removed.
+    std::map<std::string, uint64_t, std::less<>> deadCode;
+
+    // Every instruction generated inside a construct is tagged with it until the IR is counted.
+    llvm::IRBuilderBase* builder = nullptr;
+    unsigned constructKind = 0;
+    std::vector<llvm::MDNode*> constructs;
+    std::map<std::string, IRSize, std::less<>> irSizes;
+    uint64_t tapeDoublingCalls = 0;
+
+    void tagInstructions();
+
+    friend class StatsRegion;
+public:
+    explicit CompileStats(std::string source) : source(std::move(source)) {}
+
+    void countSource(const std::vector<std::string>& lines);
+
+    void countAST(std::string_view stage, NodeCounts counts);
+
+    void countDeadCode(std::string_view kind);
+
+    void startCodeGeneration(llvm::IRBuilderBase& irBuilder, const llvm::Module& module);
+
+    void enterConstruct(std::string_view kind);
+
+    void exitConstruct();
+
+    void countBasicBlock();
+
+    // Strips the tags, so the statistics do not change the output.
+    void countIR(llvm::Module& module);
+
+    void print() const;
+};
+
+// Accumulates the allocations made in the scope it lives in into the phase. Does nothing without stats.
+class StatsRegion {
+private:
+    CompileStats* stats;
+    size_t phase = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+public:
+    StatsRegion(CompileStats* stats, std::string_view name);
+
+    StatsRegion(const StatsRegion&) = delete;
+
+    ~StatsRegion();
+};
+
+// Attributes the IR generated in the scope it lives in to the construct. Does nothing without stats.
+class ConstructRegion {
+private:
+    CompileStats* stats;
+public:
+    template <typename T>
+    ConstructRegion(CompileStats* stats, const T& expr) : stats(stats) {
+        if (stats != nullptr)
+            stats->enterConstruct(getExprKind(expr));
+    }
+
+    ConstructRegion(const ConstructRegion&) = delete;
+
+    ~ConstructRegion() {
+        if (stats != nullptr)
+            stats->exitConstruct();
+    }
+};
@@ -3,8 +3,15 @@
 //
 
 #include "CompilerState.h"
+#include "CompileStats.h"
+#include "Instrumentation.h"
+#include "Profile.h"
 #include "Pointer.h"
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/Support/FileSystem.h>
+#include <algorithm>
+#include <functional>
+#include <limits>
 
 
 void CompilerState::generateEntryPoint() {
@@ -35,6 +42,8 @@ void CompilerState::return0FromMain()  {
 }
 
 llvm::BasicBlock* CompilerState::createBasicBlock(const std::string& s, llvm::Function* function)  {
+    if (stats != nullptr)
+        stats->countBasicBlock();
     return llvm::BasicBlock::Create(context, s, function);
 }
 
@@ -43,9 +52,11 @@ void CompilerState::generateTapeDoublingFunction() {
     llvm::Function* doubler = clib.declareFunction(argTypes,
                                                     builder.getVoidTy(),
                                                     false,
-                                                    "doubleTapeIfNeeded");
+                                                    getTapeDoublingFunctionName());
+    // Every module has its own copy of the helpers, so the copies must merge when the modules are linked.
+    doubler->setLinkage(llvm::GlobalValue::LinkOnceODRLinkage);
 
-    llvm::BasicBlock* functionBody = createBasicBlock("doubleTapeIfNeeded", doubler);
+    llvm::BasicBlock* functionBody = createBasicBlock(getTapeDoublingFunctionName(), doubler);
 
     builder.SetInsertPoint(functionBody);
 
@@ -64,10 +75,26 @@ void CompilerState::generateTapeDoublingFunction() {
     builder.CreateCondBr(needsToGrow, doublingTapeBB, afterDoublingTapeBB);
 
     builder.SetInsertPoint(doublingTapeBB);
-    llvm::Value* newTapeSize = builder.CreateMul(tapeSize, getConstInt(2));
-    llvm::Value* newTape = clib.generateCallCalloc(newTapeSize);
-    clib.generateCallMemcpy(newTape, tape, tapeSize);
-    clib.generateCallFree(tape);
+    // In 64 bits, so that neither the product nor the sum overflows before the size is clamped to an int.
+    auto* int64Ty = builder.getInt64Ty();
+    auto* oldSize = builder.CreateZExt(tapeSize, int64Ty);
+    auto* grownSize = builder.CreateBinaryIntrinsic(llvm::Intrinsic::umax,
+            builder.CreateMul(oldSize, builder.getInt64(tapeGrowth.factor)),
+            builder.CreateAdd(oldSize, builder.getInt64(tapeGrowth.minimumStep)));
+    // A pointer moving further than a single growth covers gets its cell right away rather than one growth per
+    // call. An index below the tape is no size to grow to.
+    auto* requiredSize = builder.CreateSelect(builder.CreateICmpSLT(newIndex, getConstInt(0)), builder.getInt64(0),
+            builder.CreateAdd(builder.CreateZExt(newIndex, int64Ty), builder.getInt64(1)));
+    auto* newSize = builder.CreateBinaryIntrinsic(llvm::Intrinsic::umin,
+            builder.CreateBinaryIntrinsic(llvm::Intrinsic::umax, grownSize, requiredSize),
+            builder.getInt64(std::numeric_limits<int32_t>::max()));
+    // realloc grows the tape in place where the heap allows, and moves the pages of a large mmap-backed tape with
+    // mremap rather than copying them. Only the new cells need zeroing.
+    auto* sizeTy = clib.getSizeTy();
+    llvm::Value* newTape = clib.generateCallRealloc(tape, builder.CreateTrunc(newSize, sizeTy));
+    builder.CreateMemSet(builder.CreateInBoundsGEP(builder.getInt8Ty(), newTape, tapeSize), builder.getInt8(0),
+                         builder.CreateTrunc(builder.CreateSub(newSize, oldSize), sizeTy), llvm::MaybeAlign(1));
+    llvm::Value* newTapeSize = builder.CreateTrunc(newSize, builder.getInt32Ty());
     builder.CreateStore(newTapeSize, tapeSizePtr);
     builder.CreateStore(newTape, tapePtr);
 
@@ -78,12 +105,102 @@ void CompilerState::generateTapeDoublingFunction() {
     builder.CreateRetVoid();
 }
 
+void CompilerState::generatePagedTapeFunctions() {
+    auto* int32Ty = builder.getInt32Ty();
+    auto* ptrTy = getPtrTy();
+    // The directory and the tables have as many slots, see kTapeDirectoryBits.
+    static_assert(kTapeDirectoryBits == kTapeTableBits);
+    auto* slots = getConstInt(1 << kTapeTableBits);
+
+    // The page of the given number, allocated with its table on first access. The slot past the last of the
+    // directory and of every table holds how many of its slots may be allocated, so that freeing the tape visits
+    // only those.
+    llvm::Function* getPage = clib.declareFunction({ptrTy, int32Ty}, ptrTy, false, "yabfpp.tape.page");
+    getPage->setLinkage(llvm::GlobalValue::LinkOnceODRLinkage);
+    builder.SetInsertPoint(createBasicBlock("yabfpp.tape.page", getPage));
+    auto getOrAllocate = [&](llvm::Value* table, llvm::Value* slot, int count, int elementSize,
+                             const std::string& name) {
+        auto* entryPtr = builder.CreateInBoundsGEP(ptrTy, table, slot);
+        auto* entry = builder.CreateLoad(Pointer{ptrTy, entryPtr});
+        auto* presentBB = builder.GetInsertBlock();
+        auto* allocateBB = createBasicBlock("allocate the " + name, getPage);
+        auto* afterBB = createBasicBlock("after allocating the " + name, getPage);
+        builder.CreateCondBr(builder.CreateIsNull(entry), allocateBB, afterBB);
+
+        builder.SetInsertPoint(allocateBB);
+        auto* allocated = clib.generateCallCalloc(getConstInt(count), elementSize);
+        builder.CreateStore(allocated, entryPtr);
+        auto* usedSlotsPtr = builder.CreateInBoundsGEP(ptrTy, table, slots);
+        auto* usedSlots = builder.CreateLoad(Pointer{int32Ty, usedSlotsPtr});
+        builder.CreateStore(builder.CreateBinaryIntrinsic(llvm::Intrinsic::umax, usedSlots,
+                                                          builder.CreateAdd(slot, getConstInt(1))), usedSlotsPtr);
+        builder.CreateBr(afterBB);
+
+        builder.SetInsertPoint(afterBB);
+        auto* result = builder.CreatePHI(ptrTy, 2, name);
+        result->addIncoming(entry, presentBB);
+        result->addIncoming(allocated, allocateBB);
+        return result;
+    };
+    llvm::Value* pageNumber = getPage->getArg(1);
+    // Room for a pointer of any target.
+    auto* table = getOrAllocate(getPage->getArg(0), builder.CreateLShr(pageNumber, kTapeTableBits),
+                                (1 << kTapeTableBits) + 1, 8, "page table");
+    auto* page = getOrAllocate(table, builder.CreateAnd(pageNumber, (1 << kTapeTableBits) - 1),
+                               1 << kTapePageBits, 1, "page");
+    builder.CreateRet(page);
+
+    // Frees the pages, the tables and the directory, visiting only the slots which may be allocated.
+    llvm::Function* freeTape = clib.declareFunction({ptrTy}, builder.getVoidTy(), false, "yabfpp.tape.free");
+    freeTape->setLinkage(llvm::GlobalValue::LinkOnceODRLinkage);
+    builder.SetInsertPoint(createBasicBlock("yabfpp.tape.free", freeTape));
+    // Calls body for the slots of the table from 0 to the used ones.
+    auto generateForUsedSlots = [&](llvm::Value* table, const std::string& name,
+                                    const std::function<void(llvm::Value*)>& body) {
+        auto* usedSlots = builder.CreateLoad(Pointer{int32Ty, builder.CreateInBoundsGEP(ptrTy, table, slots)});
+        auto* preheaderBB = builder.GetInsertBlock();
+        auto* headerBB = createBasicBlock(name, freeTape);
+        auto* bodyBB = createBasicBlock("free " + name, freeTape);
+        auto* exitBB = createBasicBlock("after " + name, freeTape);
+        builder.CreateBr(headerBB);
+
+        builder.SetInsertPoint(headerBB);
+        auto* index = builder.CreatePHI(int32Ty, 2, name + " index");
+        index->addIncoming(getConstInt(0), preheaderBB);
+        builder.CreateCondBr(builder.CreateICmpULT(index, usedSlots), bodyBB, exitBB);
+
+        builder.SetInsertPoint(bodyBB);
+        body(builder.CreateLoad(Pointer{ptrTy, builder.CreateInBoundsGEP(ptrTy, table, index)}));
+        index->addIncoming(builder.CreateAdd(index, getConstInt(1)), builder.GetInsertBlock());
+        builder.CreateBr(headerBB);
+
+        builder.SetInsertPoint(exitBB);
+    };
+    llvm::Value* directory = freeTape->getArg(0);
+    generateForUsedSlots(directory, "tables", [&](llvm::Value* freedTable) {
+        auto* presentBB = createBasicBlock("table present", freeTape);
+        auto* nextBB = createBasicBlock("next table", freeTape);
+        builder.CreateCondBr(builder.CreateIsNull(freedTable), nextBB, presentBB);
+
+        builder.SetInsertPoint(presentBB);
+        generateForUsedSlots(freedTable, "pages", [&](llvm::Value* freedPage) {
+            clib.generateCallFree(freedPage);
+        });
+        clib.generateCallFree(freedTable);
+        builder.CreateBr(nextBB);
+
+        builder.SetInsertPoint(nextBB);
+    });
+    clib.generateCallFree(directory);
+    builder.CreateRetVoid();
+}
 
 void CompilerState::generateReadCharFunction() {
     llvm::Function* readChar = clib.declareFunction({},
                                                      builder.getInt8Ty(),
                                                      false,
                                                      "readChar");
+    readChar->setLinkage(llvm::GlobalValue::LinkOnceODRLinkage);
     llvm::BasicBlock* functionBody = createBasicBlock("readChar", readChar);
     builder.SetInsertPoint(functionBody);
 
@@ -116,11 +233,14 @@ llvm::BasicBlock* CompilerState::createBasicBlock(const std::string& s)  {
     return createBasicBlock(s, getCurrentFunction());
 }
 
-void CompilerState::finalizeAndPrintIRtoFile(const std::string& outPath)  {
+void CompilerState::finalize() {
     return0FromMain();
+}
+
+void CompilerState::printIRtoFile(const std::string& outPath)  {
     std::error_code EC;
-    llvm::raw_ostream *out = new llvm::raw_fd_ostream(outPath, EC, llvm::sys::fs::OF_None);
-    module.print(*out, nullptr);
+    llvm::raw_fd_ostream out(outPath, EC, llvm::sys::fs::OF_None);
+    module.print(out, nullptr);
 }
 
 
@@ -144,6 +264,10 @@ void CompilerState::popVariableHandlerStack() {
     return functionStack.top();
 }
 
+void CompilerState::pushFunctionStack(llvm::Function* function) {
+    functionStack.push(function);
+}
+
 void CompilerState::popFunctionStack() {
     functionStack.pop();
 }
@@ -157,3 +281,30 @@ llvm::Function* CompilerState::declareBFFunction(const std::string& name, const
     return f;
 }
 
+void CompilerState::countProfileEvent(std::string_view kind, SourceLocation location, std::string_view name) {
+    if (instrumentation != nullptr)
+        instrumentation->count(*this, kind, location, name);
+}
+
+void CompilerState::applyBranchProfile(llvm::BranchInst* branch, std::string_view trueKind,
+                                       std::string_view falseKind, SourceLocation location) {
+    if (profile == nullptr)
+        return;
+    auto trueCount = profile->getCount(trueKind, location);
+    auto falseCount = profile->getCount(falseKind, location);
+    if (!trueCount.has_value() || !falseCount.has_value())
+        return;
+    // The weights are 32-bit. Like clang, add one, so that a branch never taken still has a weight.
+    uint64_t scale = std::max(*trueCount, *falseCount) / std::numeric_limits<uint32_t>::max() + 1;
+    branch->setMetadata(llvm::LLVMContext::MD_prof,
+                        llvm::MDBuilder(context).createBranchWeights(
+                                static_cast<uint32_t>(*trueCount / scale + 1),
+                                static_cast<uint32_t>(*falseCount / scale + 1)));
+}
+
+void CompilerState::applyEntryProfile(llvm::Function* function, SourceLocation location) {
+    if (profile == nullptr)
+        return;
+    if (auto count = profile->getCount("function", location))
+        function->setEntryCount(*count);
+}
@@ -25,8 +25,35 @@
 #include "ConstantHelper.h"
 #include "Pointer.h"
 #include "VariableHandler.h"
+#include "Source.h"
 #include <stack>
 
+class TimeReport;
+class CompileStats;
+class DebugInfo;
+class Instrumentation;
+class ProfileData;
+
+// How doubleTapeIfNeeded grows the tape: by factor times its size or by minimumStep cells, whichever is more, and
+// always far enough for the cell being accessed.
+struct TapeGrowth {
+    int factor = 2;
+    int minimumStep = 0;
+};
+
+// How the cells of the tape are stored. A contiguous tape is a single array doubleTapeIfNeeded grows. A paged tape
+// is a directory of tables of pages of 2^kTapePageBits cells, each allocated on first access, so that its memory
+// follows the pages the program touches rather than the furthest cell. BFMachine keeps the page of the current cell.
+enum class TapeLayout {
+    Contiguous,
+    Paged,
+};
+
+constexpr int kTapePageBits = 12;
+constexpr int kTapeTableBits = 10;
+// The rest of the 32 bits of an index.
+constexpr int kTapeDirectoryBits = 32 - kTapePageBits - kTapeTableBits;
+
 class CompilerState : public ConstantHelper {
 private:
     void generateEntryPoint();
@@ -35,12 +62,16 @@ private:
 
     llvm::LLVMContext context{};
     PlatformDependent platformDependent;
+    TapeGrowth tapeGrowth;
+    TapeLayout tapeLayout = TapeLayout::Contiguous;
     std::stack<VariableHandler> variableHandlerStack;
 
     std::stack<llvm::Function*> functionStack;
 
     void generateTapeDoublingFunction();
 
+    void generatePagedTapeFunctions();
+
     void generateReadCharFunction();
 
     void initClib() {
@@ -49,7 +80,7 @@ private:
 
 public:
     friend std::unique_ptr<CompilerState> initCompilerState(std::string_view name,
-            std::string_view targetTriple);
+            std::string_view targetTriple, TapeGrowth tapeGrowth, TapeLayout tapeLayout);
 
     CompilerState(std::string_view module_name,
                   std::string_view targetTriple,
@@ -64,12 +95,29 @@ public:
 
     [[nodiscard]] llvm::Function* getCurrentFunction() const;
 
+    [[nodiscard]] const PlatformDependent& getPlatform() const {
+        return platformDependent;
+    }
+
+    [[nodiscard]] TapeLayout getTapeLayout() const {
+        return tapeLayout;
+    }
+
+    // The helper is linkonce_odr, so the policy is part of its name: the modules built with different policies
+    // must not share it.
+    [[nodiscard]] std::string getTapeDoublingFunctionName() const {
+        return "doubleTapeIfNeeded." + std::to_string(tapeGrowth.factor) + "." +
+               std::to_string(tapeGrowth.minimumStep);
+    }
+
     auto* getPtrTy() {
         return llvm::PointerType::get(context, 0);
     }
 
     llvm::Function* declareBFFunction(const std::string& name, const std::vector<llvm::Type*>& args);
 
+    void pushFunctionStack(llvm::Function* function);
+
     void popFunctionStack();
 
     llvm::Module module;
@@ -84,11 +132,36 @@ public:
 
     CLibHandler clib;
 
+    // Set when the code generation is timed.
+    TimeReport* timeReport = nullptr;
+
+    // Set when the statistics are collected.
+    CompileStats* stats = nullptr;
+
+    // Set when the generated code is described in DWARF.
+    DebugInfo* debugInfo = nullptr;
+
+    // Set when the program counts its events at run time.
+    Instrumentation* instrumentation = nullptr;
+
+    void countProfileEvent(std::string_view kind, SourceLocation location, std::string_view name = "-");
+
+    // Set when the code is optimised for a profile an instrumented build wrote.
+    const ProfileData* profile = nullptr;
+
+    // Weighs the targets of the conditional branch by the counts the profile has for the events on either of them.
+    void applyBranchProfile(llvm::BranchInst* branch, std::string_view trueKind, std::string_view falseKind,
+                            SourceLocation location);
+
+    void applyEntryProfile(llvm::Function* function, SourceLocation location);
+
     [[nodiscard]] llvm::BasicBlock* createBasicBlock(const std::string& s, llvm::Function* function) ;
 
     [[nodiscard]] llvm::BasicBlock* createBasicBlock(const std::string& s) ;
 
-    void finalizeAndPrintIRtoFile(const std::string& outPath) ;
+    void finalize();
+
+    void printIRtoFile(const std::string& outPath) ;
 
     void setCharArrayElement(llvm::Value* arr, llvm::Value* index, llvm::Value* theChar) ;
 
@@ -107,13 +180,19 @@ public:
     }
 };
 
-inline std::unique_ptr<CompilerState> initCompilerState(std::string_view name, std::string_view targetTriple) {
+inline std::unique_ptr<CompilerState> initCompilerState(std::string_view name, std::string_view targetTriple,
+                                                        TapeGrowth tapeGrowth = {},
+                                                        TapeLayout tapeLayout = TapeLayout::Contiguous) {
     auto platformDependent = getPlatformDependent(targetTriple);
     auto state = std::make_unique<CompilerState>(name, targetTriple, platformDependent);
+    state->tapeGrowth = tapeGrowth;
+    state->tapeLayout = tapeLayout;
 
     state->initClib();
     state->generateReadCharFunction();
     state->generateTapeDoublingFunction();
+    if (tapeLayout == TapeLayout::Paged)
+        state->generatePagedTapeFunctions();
     state->generateEntryPoint();
     state->pushVariableHandlerStack();
 
@@ -0,0 +1,247 @@
+#include "ConstantPropagation.h"
+#include "CallEvaluator.h"
+#include "DeadCodeElimination.h"
+#include "ExprAnalysis.h"
+#include "ExprRewriter.h"
+
+#include <map>
+#include <utility>
+
+namespace {
+
+// What is known at the point the rewriting has reached.
+struct KnownValues {
+    // The cells by their offset from where the pointer was when the frame started. std::nullopt is unknown.
+    std::map<int, std::optional<char>> cells;
+    // Whether the cells not in the map are zero, which holds until the pointer moves by an unknown amount.
+    bool areOtherCellsZero = true;
+    // Offsets are only comparable within the same frame.
+    int frame = 0;
+    int offset = 0;
+    std::map<std::string, char> variables;
+    bool hasReturned = false;
+
+    [[nodiscard]] std::optional<char> getCell(int cellOffset) const {
+        auto it = cells.find(cellOffset);
+        if (it != cells.end())
+            return it->second;
+        if (areOtherCellsZero)
+            return 0;
+        return std::nullopt;
+    }
+
+    [[nodiscard]] std::optional<char> getCurrentCell() const { return getCell(offset); }
+
+    void setCurrentCell(std::optional<char> value) { cells[offset] = value; }
+
+    void setVariable(const std::string& name, std::optional<char> value) {
+        if (value.has_value())
+            variables[name] = *value;
+        else
+            variables.erase(name);
+    }
+};
+
+class ConstantPropagation : public ExprRewriter {
+private:
+    KnownValues known;
+    int frames = 0;
+    CallEvaluator calls;
+
+    // Forgets every cell, as when the pointer moves by an unknown amount, but the current one.
+    void startFrame(std::optional<char> currentCell) {
+        known.cells.clear();
+        known.areOtherCellsZero = false;
+        known.frame = ++frames;
+        known.offset = 0;
+        known.setCurrentCell(currentCell);
+    }
+
+    // What is known after either of the branches.
+    void join(KnownValues&& ifBranch, KnownValues&& elseBranch) {
+        if (ifBranch.hasReturned || elseBranch.hasReturned) {
+            known = std::move(ifBranch.hasReturned ? elseBranch : ifBranch);
+            return;
+        }
+        known = std::move(ifBranch);
+        std::erase_if(known.variables, [&](const auto& variable) {
+            auto it = elseBranch.variables.find(variable.first);
+            return it == elseBranch.variables.end() || it->second != variable.second;
+        });
+        if (known.frame != elseBranch.frame || known.offset != elseBranch.offset) {
+            startFrame(std::nullopt);
+            return;
+        }
+        for (const auto& [cellOffset, value] : elseBranch.cells) {
+            known.cells.try_emplace(cellOffset, known.getCell(cellOffset));
+        }
+        for (auto& [cellOffset, value] : known.cells) {
+            if (value != elseBranch.getCell(cellOffset))
+                value = std::nullopt;
+        }
+        known.areOtherCellsZero = known.areOtherCellsZero && elseBranch.areOtherCellsZero;
+    }
+
+    Int8Expr fold(const Int8Expr& expr) {
+        auto result = rewrite(expr);
+        if (auto value = getConstantValue(result))
+            return mkInt8Expr<ConstInt8Expr>(*value);
+        return result;
+    }
+public:
+    using ExprRewriter::visit;
+
+    explicit ConstantPropagation(const Expr& program) : calls(program) {}
+
+    void visit(const VariableInt8Expr& expr) override {
+        auto it = known.variables.find(expr.getName());
+        if (it != known.variables.end())
+            setResult(mkInt8Expr<ConstInt8Expr>(it->second));
+        else
+            ExprRewriter::visit(expr);
+    }
+
+    void visit(const MovePtrExpr& expr) override {
+        auto steps = fold(expr.getSteps());
+        // The steps are sign extended, whatever the signedness of char.
+        if (auto value = getConstantValue(steps))
+            known.offset += static_cast<signed char>(*value);
+        else
+            startFrame(std::nullopt);
+        setResult(mkExpr<MovePtrExpr>(std::move(steps), expr.getLocation(), expr.getChecksBounds()));
+    }
+
+    void visit(const AddExpr& expr) override {
+        auto add = fold(expr.getAdd());
+        auto value = getConstantValue(add);
+        auto cell = known.getCurrentCell();
+        if (value.has_value() && cell.has_value()) {
+            auto sum = static_cast<char>(*cell + *value);
+            known.setCurrentCell(sum);
+            setResult(mkExpr<AssignExpressionValueToTheCurrentCell>(mkInt8Expr<ConstInt8Expr>(sum),
+                                                                    expr.getLocation()));
+            return;
+        }
+        known.setCurrentCell(std::nullopt);
+        setResult(mkExpr<AddExpr>(std::move(add), expr.getLocation()));
+    }
+
+    void visit(const ReadExpr& expr) override {
+        known.setCurrentCell(std::nullopt);
+        ExprRewriter::visit(expr);
+    }
+
+    void visit(const PrintExpr& expr) override {
+        setResult(mkExpr<PrintExpr>(expr.getLocation(), known.getCurrentCell()));
+    }
+
+    void visit(const PrintIntExpr& expr) override {
+        setResult(mkExpr<PrintIntExpr>(expr.getLocation(), known.getCurrentCell()));
+    }
+
+    void visit(const AssignExpressionValueToTheCurrentCell& expr) override {
+        auto value = fold(expr.getValue());
+        known.setCurrentCell(getConstantValue(value));
+        setResult(mkExpr<AssignExpressionValueToTheCurrentCell>(std::move(value), expr.getLocation()));
+    }
+
+    void visit(const WriteToVariable& expr) override {
+        known.setVariable(expr.getName(), known.getCurrentCell());
+        ExprRewriter::visit(expr);
+    }
+
+    void visit(const LoopExpr& expr) override {
+        if (known.getCurrentCell() == 0) {
+            setResult(keepFunctionDeclarations(*this, expr.getBody()));
+            return;
+        }
+        // Any iteration but the first may start anywhere on the tape, and with the variables the body writes.
+        for (const auto& name : getWrittenVariables(expr.getBody())) {
+            known.variables.erase(name);
+        }
+        auto outer = known;
+        startFrame(std::nullopt);
+        auto body = rewrite(expr.getBody());
+        known = std::move(outer);
+        startFrame(0);
+        setResult(mkExpr<LoopExpr>(std::move(body), expr.getLocation(), expr.getBoundsCheck()));
+    }
+
+    void visit(const AffineLoopExpr& expr) override {
+        if (known.getCurrentCell() == 0) {
+            setResult(getNoOpExpr());
+            return;
+        }
+        std::vector<AffineTerm> terms;
+        for (const auto& term : expr.getTerms()) {
+            known.cells[known.offset + term.offset] = std::nullopt;
+            terms.push_back({term.offset, fold(term.coefficient)});
+        }
+        known.setCurrentCell(0);
+        setResult(mkExpr<AffineLoopExpr>(expr.getStep(), std::move(terms), expr.getLocation(),
+                                         expr.getChecksBounds()));
+    }
+
+    void visit(const IfElse& expr) override {
+        if (auto cell = known.getCurrentCell()) {
+            // Only the branch taken is left, in place of the if/else.
+            std::vector<Expr> branches;
+            if (*cell != 0) {
+                branches.push_back(rewrite(expr.getIfExpr()));
+                branches.push_back(keepFunctionDeclarations(*this, expr.getElseExpr()));
+            } else {
+                branches.push_back(keepFunctionDeclarations(*this, expr.getIfExpr()));
+                branches.push_back(rewrite(expr.getElseExpr()));
+            }
+            setResult(mkExpr<ListExpr>(std::move(branches)));
+            return;
+        }
+        auto outer = known;
+        auto ifExpr = rewrite(expr.getIfExpr());
+        auto ifBranch = std::exchange(known, std::move(outer));
+        known.setCurrentCell(0);
+        auto elseExpr = rewrite(expr.getElseExpr());
+        join(std::move(ifBranch), std::move(known));
+        setResult(mkExpr<IfElse>(std::move(ifExpr), std::move(elseExpr), expr.getLocation()));
+    }
+
+    void visit(const Return& expr) override {
+        known.hasReturned = true;
+        ExprRewriter::visit(expr);
+    }
+
+    // A function starts on a zeroed tape of its own and knows nothing of its arguments.
+    void visit(const BFFunctionDeclaration& expr) override {
+        auto outer = std::exchange(known, KnownValues{.frame = ++frames});
+        ExprRewriter::visit(expr);
+        known = std::move(outer);
+    }
+
+    // The result is written into the current cell. A call with known arguments is replaced with its result if the
+    // function can run at compile time.
+    void visit(const BFFunctionCall& expr) override {
+        std::vector<Int8Expr> arguments;
+        std::vector<char> values;
+        for (const auto& argument : expr.getArguments()) {
+            arguments.push_back(fold(argument));
+            if (auto value = getConstantValue(arguments.back()))
+                values.push_back(*value);
+        }
+        if (values.size() == arguments.size()) {
+            if (auto result = calls.evaluate(expr.getFunctionName(), values)) {
+                known.setCurrentCell(*result);
+                setResult(mkExpr<AssignExpressionValueToTheCurrentCell>(mkInt8Expr<ConstInt8Expr>(*result),
+                                                                        expr.getLocation()));
+                return;
+            }
+        }
+        known.setCurrentCell(std::nullopt);
+        setResult(mkExpr<BFFunctionCall>(expr.getFunctionName(), std::move(arguments), expr.getLocation()));
+    }
+};
+
+}
+
+Expr propagateConstants(const Expr& expr) {
+    return ConstantPropagation(expr).rewrite(expr);
+}
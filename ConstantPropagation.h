@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Expr.h"
+
+// Tracks the values of the tape cells and the variables known at compile time: the tape is zeroed at the start of
+// the program and of every function, and the cells and variables are set to constants. Folds the additions to
+// known cells into assignments, replaces the reads of known variables with their values, resolves the if/else and
+// the loops whose condition is known, prints known cells without loading them and replaces the calls with known
+// arguments with their results, when the function can run at compile time, see CallEvaluator.h.
+//
+// The knowledge is kept through the straight-line code and merged after an if/else. It is lost for the cells when
+// the pointer moves by an unknown amount, for the current cell after a call left to run and for the variables written in a loop.
+Expr propagateConstants(const Expr& expr);
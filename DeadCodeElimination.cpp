@@ -0,0 +1,250 @@
+#include "DeadCodeElimination.h"
+#include "ExprAnalysis.h"
+
+#include <map>
+#include <set>
+
+namespace {
+
+// Visits the statements of a single scope: the function declarations in it are scopes of their own.
+class ScopeVisitor : public ExprVisitor {
+public:
+    using ExprVisitor::visit;
+
+    void visit(const MinusInt8Expr& expr) override { expr.getValue().accept(*this); }
+    void visit(const MovePtrExpr& expr) override { expr.getSteps().accept(*this); }
+    void visit(const AddExpr& expr) override { expr.getAdd().accept(*this); }
+    void visit(const LoopExpr& expr) override { expr.getBody().accept(*this); }
+    void visit(const AssignExpressionValueToTheCurrentCell& expr) override { expr.getValue().accept(*this); }
+
+    void visit(const AffineLoopExpr& expr) override {
+        for (const auto& term : expr.getTerms()) {
+            term.coefficient.accept(*this);
+        }
+    }
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            e.accept(*this);
+        }
+    }
+
+    void visit(const IfElse& expr) override {
+        expr.getIfExpr().accept(*this);
+        expr.getElseExpr().accept(*this);
+    }
+
+    void visit(const BFFunctionCall& expr) override {
+        for (const auto& argument : expr.getArguments()) {
+            argument.accept(*this);
+        }
+    }
+};
+
+class VariableReads : public ScopeVisitor {
+public:
+    using ScopeVisitor::visit;
+
+    std::set<std::string> names;
+
+    void visit(const VariableInt8Expr& expr) override { names.insert(expr.getName()); }
+};
+
+class FunctionCalls : public ScopeVisitor {
+public:
+    using ScopeVisitor::visit;
+
+    std::set<std::string> callees;
+
+    void visit(const BFFunctionCall& expr) override {
+        callees.insert(expr.getFunctionName());
+        ScopeVisitor::visit(expr);
+    }
+};
+
+// The function declarations in the code, without the nested ones, which come with them.
+class OuterDeclarations : public ScopeVisitor {
+public:
+    using ScopeVisitor::visit;
+
+    std::vector<const BFFunctionDeclaration*> declarations;
+
+    void visit(const BFFunctionDeclaration& expr) override { declarations.push_back(&expr); }
+};
+
+// Removes the loops entered on a zero cell and the statements after a return, which need no knowledge beyond the
+// block they are in.
+class UnreachableCodeRemoval : public ExprRewriter {
+private:
+    CompileStats* stats;
+    // Whether the current cell is known to be zero at the point the rewriting has reached.
+    bool isCellZero = true;
+    // Whether the block has returned at that point.
+    bool hasReturned = false;
+
+    void count(std::string_view kind) {
+        if (stats != nullptr)
+            stats->countDeadCode(kind);
+    }
+
+    // Rewrites a nested block starting with the cell known to be zero or not, and leaves the state as it was.
+    Expr rewriteBlock(const Expr& block, bool isCellZeroOnEntry) {
+        auto [outerIsCellZero, outerHasReturned] = std::pair(isCellZero, hasReturned);
+        isCellZero = isCellZeroOnEntry;
+        hasReturned = false;
+        auto result = rewrite(block);
+        isCellZero = outerIsCellZero;
+        hasReturned = outerHasReturned;
+        return result;
+    }
+
+    void changeCell(auto& expr) {
+        ExprRewriter::visit(expr);
+        isCellZero = false;
+    }
+public:
+    using ExprRewriter::visit;
+
+    explicit UnreachableCodeRemoval(CompileStats* stats) : stats(stats) {}
+
+    void visit(const MovePtrExpr& expr) override { changeCell(expr); }
+    void visit(const AddExpr& expr) override { changeCell(expr); }
+    void visit(const ReadExpr& expr) override { changeCell(expr); }
+    void visit(const AssignExpressionValueToTheCurrentCell& expr) override { changeCell(expr); }
+    void visit(const BFFunctionCall& expr) override { changeCell(expr); }
+
+    void visit(const LoopExpr& expr) override {
+        if (isCellZero) {
+            count("loops entered on a zero cell");
+            setResult(keepFunctionDeclarations(*this, expr.getBody()));
+            return;
+        }
+        setResult(mkExpr<LoopExpr>(rewriteBlock(expr.getBody(), false), expr.getLocation(), expr.getBoundsCheck()));
+        isCellZero = true;
+    }
+
+    void visit(const AffineLoopExpr& expr) override {
+        if (isCellZero) {
+            count("loops entered on a zero cell");
+            setResult(getNoOpExpr());
+            return;
+        }
+        ExprRewriter::visit(expr);
+        isCellZero = true;
+    }
+
+    void visit(const IfElse& expr) override {
+        auto ifExpr = rewriteBlock(expr.getIfExpr(), false);
+        auto elseExpr = rewriteBlock(expr.getElseExpr(), true);
+        setResult(mkExpr<IfElse>(std::move(ifExpr), std::move(elseExpr), expr.getLocation()));
+        isCellZero = false;
+    }
+
+    void visit(const Return& expr) override {
+        ExprRewriter::visit(expr);
+        hasReturned = true;
+    }
+
+    // A function starts on a tape of its own, which is zeroed.
+    void visit(const BFFunctionDeclaration& expr) override {
+        setResult(mkExpr<BFFunctionDeclaration>(expr.getFunctionName(), expr.getArgumentNames(),
+                                                rewriteBlock(expr.getBody(), true), expr.getLocation()));
+    }
+
+    void visit(const ListExpr& expr) override {
+        std::vector<Expr> exprs;
+        for (const auto& e : expr.getExprs()) {
+            if (hasReturned) {
+                count("statements after a return");
+                exprs.push_back(keepFunctionDeclarations(*this, e));
+            } else {
+                exprs.push_back(rewrite(e));
+            }
+        }
+        setResult(mkExpr<ListExpr>(std::move(exprs)));
+    }
+};
+
+// Removes the functions never called and the writes to variables never read, which needs the whole program.
+class UnusedCodeRemoval : public ExprRewriter {
+private:
+    CompileStats* stats;
+    std::set<std::string> calledFunctions;
+    // A call resolves to the first declaration of the name, so a later one is never called.
+    std::set<std::string> declaredFunctions;
+    // The variables read in the scope being rewritten.
+    std::set<std::string> readVariables;
+
+    void count(std::string_view kind) {
+        if (stats != nullptr)
+            stats->countDeadCode(kind);
+    }
+
+    void setReadVariables(const Expr& scope) {
+        VariableReads reads;
+        scope.accept(reads);
+        readVariables = std::move(reads.names);
+    }
+public:
+    using ExprRewriter::visit;
+
+    UnusedCodeRemoval(CompileStats* stats, const Expr& program) : stats(stats) {
+        std::map<std::string, const BFFunctionDeclaration*> declarations;
+        for (const auto* declaration : getFunctionDeclarations(program)) {
+            declarations.emplace(declaration->getFunctionName(), declaration);
+        }
+        FunctionCalls calls;
+        program.accept(calls);
+        std::vector<std::string> pending(calls.callees.begin(), calls.callees.end());
+        while (!pending.empty()) {
+            auto it = declarations.find(pending.back());
+            pending.pop_back();
+            if (it == declarations.end() || !calledFunctions.insert(it->first).second)
+                continue;
+            FunctionCalls bodyCalls;
+            it->second->getBody().accept(bodyCalls);
+            pending.insert(pending.end(), bodyCalls.callees.begin(), bodyCalls.callees.end());
+        }
+        setReadVariables(program);
+    }
+
+    void visit(const WriteToVariable& expr) override {
+        if (readVariables.contains(expr.getName())) {
+            ExprRewriter::visit(expr);
+            return;
+        }
+        count("writes to unread variables");
+        setResult(getNoOpExpr());
+    }
+
+    void visit(const BFFunctionDeclaration& expr) override {
+        bool isFirstDeclaration = declaredFunctions.insert(expr.getFunctionName()).second;
+        if (!isFirstDeclaration || !calledFunctions.contains(expr.getFunctionName())) {
+            count("functions never called");
+            // A function declared inside may still be called from outside.
+            setResult(keepFunctionDeclarations(*this, expr.getBody()));
+            return;
+        }
+        auto outerReadVariables = std::move(readVariables);
+        setReadVariables(expr.getBody());
+        ExprRewriter::visit(expr);
+        readVariables = std::move(outerReadVariables);
+    }
+};
+
+}
+
+Expr keepFunctionDeclarations(ExprRewriter& rewriter, const Expr& removed) {
+    OuterDeclarations collector;
+    removed.accept(collector);
+    std::vector<Expr> declarations;
+    for (const auto* declaration : collector.declarations) {
+        declarations.push_back(rewriter.rewrite(*declaration));
+    }
+    return mkExpr<ListExpr>(std::move(declarations));
+}
+
+Expr eliminateDeadCode(const Expr& expr, CompileStats* stats) {
+    auto reachable = UnreachableCodeRemoval(stats).rewrite(expr);
+    return UnusedCodeRemoval(stats, reachable).rewrite(reachable);
+}
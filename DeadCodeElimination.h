@@ -0,0 +1,14 @@
+#pragma once
+
+#include "CompileStats.h"
+#include "Expr.h"
+#include "ExprRewriter.h"
+
+// Removes the code which cannot run or whose effect is never observed: the loops entered on a cell known to be zero,
+// such as a loop right after another loop or at the start of a tape, the statements after a return in the same
+// block, the functions never called and the writes to variables never read. Function declarations inside removed
+// code are kept, as they are generated wherever they appear. Counts what it removes into the stats, if any.
+Expr eliminateDeadCode(const Expr& expr, CompileStats* stats);
+
+// Stands for the code a pass removes: the function declarations in it, rewritten by the pass.
+Expr keepFunctionDeclarations(ExprRewriter& rewriter, const Expr& removed);
@@ -0,0 +1,60 @@
+#include "DebugInfo.h"
+
+#include <llvm/BinaryFormat/Dwarf.h>
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+DebugInfo::DebugInfo(llvm::Module& module, const std::string& sourcePath, bool isOptimized)
+        : diBuilder(module), isOptimized(isOptimized) {
+    llvm::SmallString<256> absolutePath(sourcePath);
+    llvm::sys::fs::make_absolute(absolutePath);
+    file = diBuilder.createFile(llvm::sys::path::filename(absolutePath), llvm::sys::path::parent_path(absolutePath));
+    // DWARF has no language code for BF++. C is what the debuggers and perf handle best.
+    diBuilder.createCompileUnit(llvm::dwarf::DW_LANG_C, file, "yabfpp", isOptimized, "", 0);
+
+    module.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    module.addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+}
+
+llvm::DIType* DebugInfo::getType(llvm::Type* type) {
+    if (type->isIntegerTy(8))
+        return diBuilder.createBasicType("char", 8, llvm::dwarf::DW_ATE_signed_char);
+    return diBuilder.createBasicType("int", type->getIntegerBitWidth(), llvm::dwarf::DW_ATE_signed);
+}
+
+void DebugInfo::beginFunction(llvm::IRBuilderBase& builder, llvm::Function* function, const std::string& name,
+                              SourceLocation location) {
+    // The result first, then the arguments.
+    std::vector<llvm::Metadata*> types = {getType(function->getReturnType())};
+    for (const auto& argument : function->args()) {
+        types.push_back(getType(argument.getType()));
+    }
+    auto flags = llvm::DISubprogram::SPFlagDefinition;
+    if (isOptimized)
+        flags |= llvm::DISubprogram::SPFlagOptimized;
+    auto* subprogram = diBuilder.createFunction(file, name, "", file, location.line,
+                                                diBuilder.createSubroutineType(diBuilder.getOrCreateTypeArray(types)),
+                                                location.line, llvm::DINode::FlagPrototyped, flags);
+    function->setSubprogram(subprogram);
+
+    scopes.push({subprogram, builder.getCurrentDebugLocation()});
+    setLocation(builder, location);
+}
+
+void DebugInfo::endFunction(llvm::IRBuilderBase& builder) {
+    diBuilder.finalizeSubprogram(scopes.top().subprogram);
+    builder.SetCurrentDebugLocation(scopes.top().enclosingLocation);
+    scopes.pop();
+}
+
+void DebugInfo::setLocation(llvm::IRBuilderBase& builder, SourceLocation location) const {
+    if (location.line == 0)
+        return;
+    builder.SetCurrentDebugLocation(llvm::DILocation::get(builder.getContext(), location.line, location.column,
+                                                          scopes.top().subprogram));
+}
+
+void DebugInfo::finalize() {
+    diBuilder.finalize();
+}
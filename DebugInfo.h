@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stack>
+#include <string>
+
+#include "Source.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/IRBuilder.h"
+
+// Describes the generated code in DWARF: a compile unit for the source, a subprogram for main and for every BF++
+// function, and the line and the column of the source character every instruction was generated for.
+class DebugInfo {
+private:
+    struct Scope {
+        llvm::DISubprogram* subprogram;
+        // Where the builder was in the enclosing function.
+        llvm::DebugLoc enclosingLocation;
+    };
+
+    llvm::DIBuilder diBuilder;
+    llvm::DIFile* file;
+    bool isOptimized;
+    std::stack<Scope> scopes;
+
+    llvm::DIType* getType(llvm::Type* type);
+public:
+    DebugInfo(llvm::Module& module, const std::string& sourcePath, bool isOptimized);
+
+    // The instructions generated until endFunction belong to the function.
+    void beginFunction(llvm::IRBuilderBase& builder, llvm::Function* function, const std::string& name,
+                       SourceLocation location);
+
+    void endFunction(llvm::IRBuilderBase& builder);
+
+    // Does nothing for a node the parser did not produce, so that it belongs to the enclosing construct.
+    void setLocation(llvm::IRBuilderBase& builder, SourceLocation location) const;
+
+    // Call once every function has ended.
+    void finalize();
+};
+
+// Attributes the instructions generated for the construct to its location, and the ones after it back to the
+// enclosing construct. Nodes without a location, like the Int8Exprs, are left to the construct they are part of.
+class DebugLocationRegion {
+private:
+    DebugInfo* debugInfo = nullptr;
+    llvm::IRBuilderBase& builder;
+    llvm::DebugLoc enclosingLocation;
+public:
+    template <typename T>
+    DebugLocationRegion(DebugInfo* debugInfo, llvm::IRBuilderBase& builder, const T& expr)
+            : builder(builder), enclosingLocation(builder.getCurrentDebugLocation()) {
+        if constexpr (requires { expr.getLocation(); }) {
+            if (debugInfo != nullptr) {
+                this->debugInfo = debugInfo;
+                debugInfo->setLocation(builder, expr.getLocation());
+            }
+        }
+    }
+
+    DebugLocationRegion(const DebugLocationRegion&) = delete;
+
+    ~DebugLocationRegion() {
+        if (debugInfo != nullptr)
+            builder.SetCurrentDebugLocation(enclosingLocation);
+    }
+};
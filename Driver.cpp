@@ -0,0 +1,475 @@
+#include "Driver.h"
+#include "CompilerState.h"
+#include "DebugInfo.h"
+#include "ExprAnalysis.h"
+#include "IncrementalCompiler.h"
+#include "LibraryExport.h"
+#include "Instrumentation.h"
+#include "Optimizer.h"
+#include "ParallelOptimizer.h"
+#include "PassPipeline.h"
+#include "Profile.h"
+#include "RecordRunner.h"
+#include "StreamingParser.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <print>
+#include <thread>
+
+namespace {
+
+// The time report and the statistics follow the same phases.
+class Phase {
+private:
+    PhaseRegion timeRegion;
+    StatsRegion statsRegion;
+public:
+    Phase(CompileReports& reports, std::string_view name)
+            : timeRegion(reports.time.get(), name), statsRegion(reports.stats.get(), name) {}
+};
+
+// Everything the emitted IR depends on besides the source.
+std::vector<std::string> getCodegenOptions(const std::string& inputPath, const CompileOptions& options,
+                                           const std::string& targetTriple,
+                                           const std::optional<std::vector<ProfileEntry>>& profile) {
+    std::vector<std::string> codegenOptions = {
+        targetTriple,
+        std::to_string(options.tapeSize),
+        std::format("growth {} {}", options.tapeGrowth.factor, options.tapeGrowth.minimumStep),
+        options.tapeLayout == TapeLayout::Paged ? "paged" : "contiguous",
+        options.legacyMode ? "legacy" : "modern",
+        options.astOptimization ? "AST optimized" : "AST as parsed",
+        std::to_string(options.optLevel),
+        options.splitModule ? "split" : "whole",
+        options.instrument ? "instrumented " + options.profilePath : "plain",
+        // The debug info names the source file.
+        options.debugInfo ? "debug info " + std::filesystem::absolute(inputPath).string() : "no debug info",
+        options.records ? "records" : "single",
+        options.library ? "library " + options.librarySymbol : "executable",
+        options.stream ? "streamed" : "whole program",
+    };
+    // The counts rather than the path, so that a new profile in the same file is a different compilation.
+    if (profile.has_value()) {
+        for (const auto& entry : *profile) {
+            codegenOptions.push_back(std::format("{} {} {} {} {}", entry.kind, entry.location.line,
+                                                 entry.location.column, entry.name, entry.count));
+        }
+    }
+    return codegenOptions;
+}
+
+// The header of a library goes next to its IR. It depends on nothing but the symbol and the source, so it is written
+// on a cache hit too.
+std::expected<void, std::string> writeLibraryHeader(const std::string& inputPath, const std::string& outputPath,
+                                                    const CompileOptions& options) {
+    if (!options.library)
+        return {};
+    auto headerPath = std::filesystem::path(outputPath).replace_extension(".h").string();
+    std::ofstream header(headerPath);
+    header << getLibraryHeader(options.librarySymbol, inputPath);
+    if (!header)
+        return std::unexpected("Cannot write " + headerPath);
+    return {};
+}
+
+// Generates every top-level construct as soon as it is parsed, so that the AST of the whole program is never held.
+// The stats count the nodes of all the constructs together.
+std::expected<void, std::string> generateStreamed(const Source& src, BFMachine& bfMachine, bool astOptimization,
+                                                  CompileStats* stats) {
+    NodeCounts parsedCounts;
+    NodeCounts optimizedCounts;
+    auto addCounts = [](NodeCounts& total, const NodeCounts& counts) {
+        for (const auto& [kind, count] : counts) {
+            total[kind] += count;
+        }
+    };
+    auto streamed = parseConcurrently(src, [&](Expr construct) {
+        if (stats != nullptr)
+            addCounts(parsedCounts, countNodes(construct));
+        auto optimized = astOptimization ? optimizeConstruct(construct) : std::move(construct);
+        if (stats != nullptr)
+            addCounts(optimizedCounts, countNodes(optimized));
+        optimized.generate(bfMachine);
+    });
+    if (stats != nullptr) {
+        stats->countAST("parsed", std::move(parsedCounts));
+        stats->countAST("optimized", std::move(optimizedCounts));
+    }
+    return streamed;
+}
+
+// What is read once for all the targets.
+struct FrontEnd {
+    Source src;
+    std::optional<std::vector<ProfileEntry>> profile;
+};
+
+std::expected<FrontEnd, std::string> readFrontEnd(const std::string& inputPath, const CompileOptions& options,
+                                                  CompileReports& reports) {
+    auto program = [&] {
+        Phase phase(reports, "reading");
+        return readFile(inputPath);
+    }();
+    if (!program.has_value())
+        return std::unexpected("Input file doesn't exist");
+    if (reports.stats != nullptr)
+        reports.stats->countSource(*program);
+
+    Source src = [&] {
+        Phase phase(reports, "source normalisation");
+        return getSource(program.value(), options.legacyMode);
+    }();
+
+    std::optional<std::vector<ProfileEntry>> profile;
+    if (!options.profileUsePath.empty()) {
+        Phase phase(reports, "profile reading");
+        profile = readProfile(options.profileUsePath);
+        if (!profile.has_value())
+            return std::unexpected("Cannot read " + options.profileUsePath);
+    }
+    return FrontEnd{std::move(src), std::move(profile)};
+}
+
+// Streamed, the program is parsed along with the code generation, and there is no AST yet.
+std::expected<std::optional<Expr>, std::string> parseAndOptimize(const Source& src, const CompileOptions& options,
+                                                                 CompileReports& reports) {
+    if (options.stream)
+        return std::nullopt;
+    auto parsed = [&] {
+        Phase phase(reports, "parsing");
+        return Parser().tryParse(src);
+    }();
+    if (!parsed.has_value())
+        return std::unexpected(std::move(parsed.error()));
+    if (reports.stats != nullptr)
+        reports.stats->countAST("parsed", countNodes(*parsed));
+    if (!options.astOptimization)
+        return std::move(*parsed);
+
+    auto expr = [&] {
+        Phase phase(reports, "AST optimization");
+        return optimize(*parsed, reports.stats.get());
+    }();
+    if (reports.stats != nullptr)
+        reports.stats->countAST("optimized", countNodes(expr));
+    return expr;
+}
+
+std::string getTargetCacheKey(const std::string& inputPath, const CompileOptions& options,
+                              const std::string& targetTriple, const FrontEnd& frontEnd) {
+    // Only the profiles and the debug info tell the constructs by their place in the source.
+    bool withLocations = options.instrument || frontEnd.profile.has_value() || options.debugInfo;
+    auto codegenOptions = getCodegenOptions(inputPath, options, targetTriple, frontEnd.profile);
+    return getCacheKey(frontEnd.src, codegenOptions, withLocations) + ".ll";
+}
+
+// Generates the IR of the program for the target and writes it to outputPath, stored in the cache under the key.
+std::expected<void, std::string> generateIR(const std::string& inputPath, const std::string& outputPath,
+                                            const CompileOptions& options, const std::string& targetTriple,
+                                            const FrontEnd& frontEnd, const std::optional<Expr>& expr,
+                                            const std::string& cacheKey, CompileReports& reports) {
+    const auto& src = frontEnd.src;
+    const auto& profile = frontEnd.profile;
+
+    if (options.incremental) {
+        if (options.stream)
+            return std::unexpected("--incremental cannot be combined with --stream");
+        if (options.tapeLayout == TapeLayout::Paged)
+            return std::unexpected("--incremental cannot be combined with --tape=paged");
+        if (!options.cache.has_value())
+            return std::unexpected("--incremental requires --cache-dir");
+        if (options.instrument)
+            return std::unexpected("--incremental cannot be combined with --instrument");
+        if (profile.has_value())
+            return std::unexpected("--incremental cannot be combined with --profile-use");
+        if (options.debugInfo)
+            return std::unexpected("--incremental cannot be combined with --debug-info");
+        if (options.records)
+            return std::unexpected("--incremental cannot be combined with --records");
+        if (options.library)
+            return std::unexpected("--incremental cannot be combined with --emit-lib");
+        Phase phase(reports, "incremental compilation");
+        if (!compileIncrementally(*expr, *options.cache, inputPath, targetTriple, options.tapeSize,
+                                  options.tapeGrowth,
+                                  options.optLevel, outputPath))
+            return std::unexpected("Cannot write " + outputPath);
+    } else {
+        // The profile would be written by every run, and the runs are on different threads.
+        if (options.records && options.instrument)
+            return std::unexpected("--records cannot be combined with --instrument");
+        if (options.library && options.instrument)
+            return std::unexpected("--emit-lib cannot be combined with --instrument");
+        if (options.library && options.records)
+            return std::unexpected("--emit-lib cannot be combined with --records");
+        auto state = initCompilerState(inputPath, targetTriple, options.tapeGrowth, options.tapeLayout);
+        state->timeReport = reports.time.get();
+        state->stats = reports.stats.get();
+        if (reports.stats != nullptr)
+            reports.stats->startCodeGeneration(state->builder, state->module);
+        std::optional<Instrumentation> instrumentation;
+        if (options.instrument) {
+            instrumentation.emplace(options.profilePath);
+            state->instrumentation = &*instrumentation;
+        }
+        std::optional<ProfileData> profileData;
+        if (profile.has_value()) {
+            profileData.emplace(*profile);
+            state->profile = &*profileData;
+            // Every other entry count is relative to the single run of the program.
+            state->getCurrentFunction()->setEntryCount(1);
+        }
+        std::optional<DebugInfo> debugInfo;
+        if (options.debugInfo) {
+            debugInfo.emplace(state->module, inputPath, options.optLevel > 0);
+            state->debugInfo = &*debugInfo;
+            debugInfo->beginFunction(state->builder, state->getCurrentFunction(), "main", {1, 1});
+        }
+        {
+            Phase phase(reports, options.stream ? "streamed parsing and code generation" : "code generation");
+            BFMachine bfMachine = createBFMachine(state.get(), options.tapeSize);
+            if (options.stream) {
+                auto streamed = generateStreamed(src, bfMachine, options.astOptimization, reports.stats.get());
+                if (!streamed.has_value())
+                    return std::unexpected(std::move(streamed.error()));
+            } else {
+                expr->generate(bfMachine);
+            }
+            // Every record and every call gets a tape of its own.
+            if (options.records || options.library)
+                bfMachine.generateFreeTape();
+            state->finalize();
+            // The profile writer is not part of the source, neither is the record runner.
+            if (debugInfo.has_value()) {
+                debugInfo->endFunction(state->builder);
+                debugInfo->finalize();
+            }
+            if (options.records)
+                generateRecordRunner(*state);
+            if (options.library)
+                generateLibrary(*state, options.librarySymbol);
+            if (instrumentation.has_value())
+                instrumentation->finalize(*state);
+        }
+        if (reports.stats != nullptr)
+            reports.stats->countIR(state->module);
+
+        if (options.splitModule && options.optLevel > 0) {
+            Phase phase(reports, "split IR optimization and printing");
+            if (!optimizeInPartitions(state->module, options.optLevel, options.jobs, outputPath))
+                return std::unexpected("Cannot write " + outputPath);
+        } else {
+            {
+                Phase phase(reports, "IR optimization");
+                runOptimizationPipeline(state->module, options.optLevel);
+            }
+            Phase phase(reports, "IR printing");
+            state->printIRtoFile(outputPath);
+        }
+    }
+
+    if (options.cache.has_value()) {
+        Phase phase(reports, "cache store");
+        options.cache->storeFile(cacheKey, outputPath);
+    }
+    return writeLibraryHeader(inputPath, outputPath, options);
+}
+
+// a.ll becomes a.wasm32-unknown-emscripten.ll.
+std::string getTargetOutputPath(const std::string& outputPath, const std::string& targetTriple) {
+    auto path = std::filesystem::path(outputPath);
+    return path.replace_extension("." + targetTriple + path.extension().string()).string();
+}
+
+// Parses the program once and generates it for every target on a thread of its own, into a module of the target,
+// each written next to outputPath. The reports of every target are kept in reports.targets.
+std::expected<void, std::string> compileForTargets(const std::string& inputPath, const std::string& outputPath,
+                                                   const CompileOptions& options, const FrontEnd& frontEnd,
+                                                   CompileReports& reports) {
+    // The constructs would have to be handed to every target as they are parsed.
+    if (options.stream)
+        return std::unexpected("--stream cannot be combined with several targets");
+    auto targetCount = options.targetTriples.size();
+    std::vector<std::string> outputPaths;
+    std::vector<std::string> cacheKeys(targetCount);
+    std::vector<size_t> uncached;
+    for (size_t index = 0; index < targetCount; index++) {
+        const auto& targetTriple = options.targetTriples[index];
+        outputPaths.push_back(getTargetOutputPath(outputPath, targetTriple));
+        if (options.cache.has_value()) {
+            Phase phase(reports, "cache lookup");
+            cacheKeys[index] = getTargetCacheKey(inputPath, options, targetTriple, frontEnd);
+            if (options.cache->fetch(cacheKeys[index], outputPaths[index])) {
+                auto header = writeLibraryHeader(inputPath, outputPaths[index], options);
+                if (!header.has_value())
+                    return header;
+                continue;
+            }
+        }
+        uncached.push_back(index);
+    }
+    if (uncached.empty())
+        return {};
+
+    auto expr = parseAndOptimize(frontEnd.src, options, reports);
+    if (!expr.has_value())
+        return std::unexpected(std::move(expr.error()));
+
+    // The targets share the cores the partitions of a split module would take.
+    CompileOptions targetOptions = options;
+    int jobs = options.jobs > 0 ? options.jobs : static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    targetOptions.jobs = std::max(jobs / static_cast<int>(uncached.size()), 1);
+
+    // Every target has a context of its own, and the AST is only read.
+    std::vector<std::expected<void, std::string>> results(targetCount);
+    reports.targets.resize(targetCount);
+    std::vector<std::thread> workers;
+    for (auto index : uncached) {
+        reports.targets[index] = createReports(inputPath + " for " + options.targetTriples[index], options);
+        workers.emplace_back([&, index] {
+            Phase total(reports.targets[index], "total");
+            results[index] = generateIR(inputPath, outputPaths[index], targetOptions, options.targetTriples[index],
+                                        frontEnd, *expr, cacheKeys[index], reports.targets[index]);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (size_t index = 0; index < targetCount; index++) {
+        if (!results[index].has_value())
+            return std::unexpected(options.targetTriples[index] + ": " + results[index].error());
+    }
+    return {};
+}
+
+}
+
+std::expected<void, std::string> compileFile(const std::string& inputPath, const std::string& outputPath,
+                                             const CompileOptions& options, CompileReports& reports) {
+    Phase total(reports, "total");
+
+    auto frontEnd = readFrontEnd(inputPath, options, reports);
+    if (!frontEnd.has_value())
+        return std::unexpected(std::move(frontEnd.error()));
+
+    if (options.targetTriples.size() > 1)
+        return compileForTargets(inputPath, outputPath, options, *frontEnd, reports);
+
+    const auto& targetTriple = options.targetTriples.front();
+    std::string cacheKey;
+    if (options.cache.has_value()) {
+        Phase phase(reports, "cache lookup");
+        cacheKey = getTargetCacheKey(inputPath, options, targetTriple, *frontEnd);
+        if (options.cache->fetch(cacheKey, outputPath))
+            return writeLibraryHeader(inputPath, outputPath, options);
+    }
+
+    auto expr = parseAndOptimize(frontEnd->src, options, reports);
+    if (!expr.has_value())
+        return std::unexpected(std::move(expr.error()));
+    return generateIR(inputPath, outputPath, options, targetTriple, *frontEnd, *expr, cacheKey, reports);
+}
+
+CompileReports createReports(const std::string& inputPath, const CompileOptions& options) {
+    CompileReports reports;
+    if (options.printTimeReport || !options.timeReportPath.empty())
+        reports.time = std::make_unique<TimeReport>(inputPath);
+    if (options.printStats)
+        reports.stats = std::make_unique<CompileStats>(inputPath);
+    return reports;
+}
+
+bool printReports(const std::vector<CompileReports>& reports, const CompileOptions& options) {
+    // Every target after the source it was generated from.
+    std::vector<const CompileReports*> allReports;
+    for (const auto& report : reports) {
+        allReports.push_back(&report);
+        for (const auto& target : report.targets) {
+            if (target.time != nullptr || target.stats != nullptr)
+                allReports.push_back(&target);
+        }
+    }
+    for (const auto* report : allReports) {
+        if (options.printTimeReport)
+            report->time->print(options.timeReportFunctions);
+        if (options.printStats)
+            report->stats->print();
+    }
+    if (options.timeReportPath.empty())
+        return true;
+
+    std::error_code error;
+    llvm::raw_fd_ostream out(options.timeReportPath, error);
+    if (error)
+        return false;
+    llvm::json::OStream json(out, 2);
+    json.array([&] {
+        for (const auto* report : allReports) {
+            report->time->writeJSON(json, options.timeReportFunctions);
+        }
+    });
+    return true;
+}
+
+std::expected<std::vector<std::string>, std::string> expandResponseFiles(const std::vector<std::string>& arguments) {
+    std::vector<std::string> paths;
+    for (const auto& argument : arguments) {
+        if (!argument.starts_with('@')) {
+            paths.push_back(argument);
+            continue;
+        }
+        std::ifstream responseFile(argument.substr(1));
+        if (!responseFile)
+            return std::unexpected("Response file " + argument.substr(1) + " doesn't exist");
+        for (std::string line; std::getline(responseFile, line);) {
+            if (!line.empty())
+                paths.push_back(line);
+        }
+    }
+    return paths;
+}
+
+int compileBatch(const std::vector<std::string>& inputPaths, const CompileOptions& options) {
+    // The sources already keep all the threads busy.
+    CompileOptions sourceOptions = options;
+    sourceOptions.jobs = 1;
+
+    std::vector<std::expected<void, std::string>> results(inputPaths.size());
+    std::vector<CompileReports> reports(inputPaths.size());
+    std::atomic<size_t> nextSource = 0;
+    auto compileSources = [&] {
+        for (size_t index = nextSource++; index < inputPaths.size(); index = nextSource++) {
+            auto outputPath = std::filesystem::path(inputPaths[index]).replace_extension(".ll").string();
+            reports[index] = createReports(inputPaths[index], options);
+            results[index] = compileFile(inputPaths[index], outputPath, sourceOptions, reports[index]);
+        }
+    };
+
+    int jobs = options.jobs > 0 ? options.jobs : static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    std::vector<std::thread> workers;
+    for (int i = 0; i < std::min<int>(jobs, inputPaths.size()); i++) {
+        workers.emplace_back(compileSources);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Reported in the order of the sources, so that the output does not depend on the scheduling.
+    int failures = 0;
+    for (size_t index = 0; index < inputPaths.size(); index++) {
+        if (!results[index].has_value()) {
+            std::println("{}: {}", inputPaths[index], results[index].error());
+            failures++;
+        }
+    }
+    if (!printReports(reports, options)) {
+        std::println("Cannot write {}", options.timeReportPath);
+        failures++;
+    }
+    return failures;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <expected>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "CompilationCache.h"
+#include "CompileStats.h"
+#include "CompilerState.h"
+#include "TimeReport.h"
+
+struct CompileOptions {
+    // The program is parsed once and generated for every target, see compileFile.
+    std::vector<std::string> targetTriples;
+    int tapeSize;
+    TapeGrowth tapeGrowth;
+    TapeLayout tapeLayout;
+    bool legacyMode;
+    // Whether the AST passes of Optimizer.h run. Without them the IR is generated from the AST as parsed.
+    bool astOptimization;
+    int optLevel;
+    bool splitModule;
+    bool incremental;
+    int jobs;
+    // Not set without --cache-dir.
+    std::optional<CompilationCache> cache;
+    bool printTimeReport;
+    // Empty unless the time reports are written as JSON.
+    std::string timeReportPath;
+    int timeReportFunctions;
+    bool printStats;
+    bool debugInfo;
+    bool instrument;
+    // Where an instrumented program writes its profile.
+    std::string profilePath;
+    // Empty unless the code is optimised for the profile of an instrumented build.
+    std::string profileUsePath;
+    // Whether the program runs once per framed input record, on several threads. See RecordRunner.h.
+    bool records;
+    // Whether the program is exported as a function of the buffers it reads and writes, see LibraryExport.h, with
+    // its header written next to the IR.
+    bool library;
+    std::string librarySymbol;
+    // Whether every top-level construct is generated as soon as it is parsed and then freed, see StreamingParser.h,
+    // without the AST passes over the whole program.
+    bool stream;
+};
+
+// What is measured while compiling a single source. Either is nullptr unless asked for.
+struct CompileReports {
+    std::unique_ptr<TimeReport> time;
+    std::unique_ptr<CompileStats> stats;
+    // The code generation for every target when there are several, by the index of the target.
+    std::vector<CompileReports> targets;
+};
+
+CompileReports createReports(const std::string& inputPath, const CompileOptions& options);
+
+// Compiles the source to IR written to outputPath, measuring it into the reports. Returns the message to report
+// otherwise. With several targets the source is parsed once and the IR of every target is generated in parallel,
+// written to outputPath with the target triple before its extension.
+std::expected<void, std::string> compileFile(const std::string& inputPath, const std::string& outputPath,
+                                             const CompileOptions& options, CompileReports& reports);
+
+// Prints the reports and writes the time reports to options.timeReportPath as a JSON array. Returns false if
+// it cannot be written.
+bool printReports(const std::vector<CompileReports>& reports, const CompileOptions& options);
+
+// Replaces every argument of the form @file with the paths listed in the file, one per line.
+std::expected<std::vector<std::string>, std::string> expandResponseFiles(const std::vector<std::string>& arguments);
+
+// Compiles every source to IR next to it on options.jobs threads. A thread compiles one source after another, and
+// a source which fails to compile does not stop the others. Returns the number of failed sources.
+int compileBatch(const std::vector<std::string>& inputPaths, const CompileOptions& options);
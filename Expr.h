@@ -3,7 +3,13 @@
 //
 
 #include "BFMachine.h"
+#include "CompileStats.h"
+#include "DebugInfo.h"
+#include "ExprVisitor.h"
+#include "Source.h"
+#include "TimeReport.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include <optional>
 #include <utility>
 #include <woid.hpp>
 
@@ -16,10 +22,16 @@ template <typename R>
 struct ExprBase : woid::InterfaceBuilder
                       ::With<woid::VTableOwnership::DEDICATED>
                       ::WithStorage<woid::TrivialStorage<8, woid::Copy::DISABLED>>
-                      ::Fun<"generate", [](const auto& obj, BFMachine& bfm) -> R { return obj.generate(bfm); }>
+                      ::Fun<"generate", [](const auto& obj, BFMachine& bfm) -> R {
+                          ConstructRegion region(bfm.state->stats, obj);
+                          DebugLocationRegion debugLocation(bfm.state->debugInfo, bfm.state->builder, obj);
+                          return obj.generate(bfm);
+                      }>
+                      ::Fun<"accept", [](const auto& obj, ExprVisitor& visitor) -> void { visitor.visit(obj); }>
                       ::Build {
     using ExprBase<R>::Self::Self;
     R generate(BFMachine& bfm) const { return this-> template call<"generate">(bfm); }
+    void accept(ExprVisitor& visitor) const { this-> template call<"accept">(visitor); }
 };
 
 inline auto mkExprBase = []<typename E, typename T, typename ... Args>(std::in_place_type_t<E>, std::in_place_type_t<T>, Args&&... args) { 
@@ -48,6 +60,8 @@ public:
         CompilerState* state = bfMachine.state;
         return state->builder.CreateMul(beforeMinus, state->getConstChar(-1));
     }
+
+    [[nodiscard]] const Int8Expr& getValue() const { return value; }
 };
 
 class VariableInt8Expr {
@@ -59,6 +73,8 @@ public:
     llvm::Value* generate(BFMachine& bfMachine) const {
         return bfMachine.state->getVariableHandler().getVariableValue(name);
     }
+
+    [[nodiscard]] const std::string& getName() const { return name; }
 };
 
 class ConstInt8Expr {
@@ -70,13 +86,19 @@ public:
     llvm::Value* generate(BFMachine& bfMachine) const {
         return bfMachine.state->getConstChar(value);
     }
+
+    [[nodiscard]] char getValue() const { return value; }
 };
 
 class MovePtrExpr {
 private:
     Int8Expr steps;
+    SourceLocation location;
+    // False when an enclosing loop checks the bounds for its whole body, see BoundsCheckHoisting.h.
+    bool checksBounds;
 public:
-    explicit MovePtrExpr(Int8Expr steps) : steps(std::move(steps)) {}
+    explicit MovePtrExpr(Int8Expr steps, SourceLocation location = {}, bool checksBounds = true)
+        : steps(std::move(steps)), location(location), checksBounds(checksBounds) {}
 
     void generate(BFMachine& bfMachine) const {
         llvm::Value* index = bfMachine.getIndex();
@@ -88,57 +110,125 @@ public:
         llvm::Value* stepValueI32 = builder.CreateIntCast(stepValueI8, builder.getInt32Ty(), true);
         auto newIndex = state.CreateAdd(index, stepValueI32, "move pointer");
 
-        bfMachine.generateCallTapeDoublingFunction(newIndex);
+        if (checksBounds)
+            bfMachine.generateCallTapeDoublingFunction(newIndex);
 
-        builder.CreateStore(newIndex, bfMachine.pointer.pointer);
+        bfMachine.setIndex(newIndex);
     }
+
+    [[nodiscard]] const Int8Expr& getSteps() const { return steps; }
+
+    [[nodiscard]] bool getChecksBounds() const { return checksBounds; }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
 };
 
 class AddExpr {
 private:
     Int8Expr add;
+    SourceLocation location;
 public:
-    explicit AddExpr(Int8Expr add) : add(std::move(add)) {}
+    explicit AddExpr(Int8Expr add, SourceLocation location = {}) : add(std::move(add)), location(location) {}
 
     void generate(BFMachine& bfMachine) const {
         llvm::Value* theChar = bfMachine.getCurrentChar();
         llvm::Value* newChar = bfMachine.state->CreateAdd(theChar, add.generate(bfMachine), "add char");
         bfMachine.setCurrentChar(newChar);
     }
+
+    [[nodiscard]] const Int8Expr& getAdd() const { return add; }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
 };
 
 class ReadExpr {
+private:
+    SourceLocation location;
 public:
+    explicit ReadExpr(SourceLocation location = {}) : location(location) {}
+
     void generate(BFMachine& bfMachine) const {
         llvm::Value* readChar = bfMachine.state->generateCallReadCharFunction();
         bfMachine.setCurrentChar(readChar);
     }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
 };
 
 class PrintExpr {
+private:
+    SourceLocation location;
+    // The value of the current cell when it is known at compile time, which is printed without loading the cell.
+    std::optional<char> knownValue;
 public:
+    explicit PrintExpr(SourceLocation location = {}, std::optional<char> knownValue = {})
+        : location(location), knownValue(knownValue) {}
+
     void generate(BFMachine& bfMachine) const {
-        bfMachine.state->clib.generateCallPutChar(bfMachine.getCurrentChar());
+        auto* state = bfMachine.state;
+        state->clib.generateCallPutChar(knownValue.has_value() ? state->getConstChar(*knownValue)
+                                                               : bfMachine.getCurrentChar());
     }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
+
+    [[nodiscard]] const std::optional<char>& getKnownValue() const { return knownValue; }
 };
 
 class PrintIntExpr {
+private:
+    SourceLocation location;
+    // See PrintExpr.
+    std::optional<char> knownValue;
 public:
+    explicit PrintIntExpr(SourceLocation location = {}, std::optional<char> knownValue = {})
+        : location(location), knownValue(knownValue) {}
+
     void generate(BFMachine& bfMachine) const {
-        bfMachine.state->clib.generateCallPrintfInt(bfMachine.getCurrentChar());
+        auto* state = bfMachine.state;
+        state->clib.generateCallPrintfInt(knownValue.has_value() ? state->getConstChar(*knownValue)
+                                                                 : bfMachine.getCurrentChar());
     }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
+
+    [[nodiscard]] const std::optional<char>& getKnownValue() const { return knownValue; }
 };
 
 
+// The single tape bounds check of a loop whose body only moves the pointer by constants, standing for the checks of
+// the moves in the body. It covers the cell maxOffset cells right of the pointer.
+struct HoistedBoundsCheck {
+    // The body has a net pointer movement, so every iteration starts elsewhere and is checked on its own. Otherwise
+    // the loop is checked once before it is entered.
+    bool perIteration;
+    int maxOffset;
+};
+
 class LoopExpr {
 private:
     Expr body;
+    SourceLocation location;
+    std::optional<HoistedBoundsCheck> boundsCheck;
+
+    void generateBoundsCheck(BFMachine& bfMachine) const {
+        auto& state = *bfMachine.state;
+        bfMachine.generateCallTapeDoublingFunction(state.CreateAdd(bfMachine.getIndex(),
+                                                                   state.getConstInt(boundsCheck->maxOffset),
+                                                                   "hoisted bounds check"));
+    }
 public:
-    explicit LoopExpr(Expr body): body(std::move(body)) {}
+    explicit LoopExpr(Expr body, SourceLocation location = {},
+                      std::optional<HoistedBoundsCheck> boundsCheck = std::nullopt)
+        : body(std::move(body)), location(location), boundsCheck(boundsCheck) {}
 
     void generate(BFMachine& bfMachine) const  {
         auto& state = *bfMachine.state;
         auto& builder = state.builder;
+        // The tape never grows to the left, so a loop staying left of where it starts needs no check.
+        bool checks = boundsCheck.has_value() && boundsCheck->maxOffset > 0;
+        if (checks && !boundsCheck->perIteration)
+            generateBoundsCheck(bfMachine);
         llvm::BasicBlock* loopCondBB = state.createBasicBlock("loop cond");
         llvm::BasicBlock* loopBodyBB = state.createBasicBlock("loop body");
         llvm::BasicBlock* afterLoopBB = state.createBasicBlock("after loop");
@@ -147,14 +237,79 @@ public:
         builder.SetInsertPoint(loopCondBB);
         auto cond = builder.CreateICmpNE(bfMachine.getCurrentChar(), state.getConstChar(0),
                 "check loop condition");
-        builder.CreateCondBr(cond, loopBodyBB, afterLoopBB);
+        state.applyBranchProfile(builder.CreateCondBr(cond, loopBodyBB, afterLoopBB), "loop", "exit", location);
 
         builder.SetInsertPoint(loopBodyBB);
+        if (checks && boundsCheck->perIteration)
+            generateBoundsCheck(bfMachine);
         body.generate(bfMachine);
+        state.countProfileEvent("loop", location);
         builder.CreateBr(loopCondBB);
 
         builder.SetInsertPoint(afterLoopBB);
+        state.countProfileEvent("exit", location);
     }
+
+    [[nodiscard]] const Expr& getBody() const { return body; }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
+
+    [[nodiscard]] const std::optional<HoistedBoundsCheck>& getBoundsCheck() const { return boundsCheck; }
+};
+
+struct AffineTerm {
+    int offset;
+    Int8Expr coefficient;
+};
+
+// A loop which runs with zero net pointer movement, changes the loop cell by `step` (either 1 or -1) per iteration
+// and only adds loop invariant values to other cells. It is generated as `cell[offset] += coefficient * n`
+// for every term, where n is the number of iterations the loop would run, followed by zeroing the loop cell.
+class AffineLoopExpr {
+private:
+    char step;
+    std::vector<AffineTerm> terms;
+    SourceLocation location;
+    // False when an enclosing loop checks the bounds for its whole body.
+    bool checksBounds;
+public:
+    AffineLoopExpr(char step, std::vector<AffineTerm>&& terms, SourceLocation location = {}, bool checksBounds = true)
+        : step(step), terms(std::move(terms)), location(location), checksBounds(checksBounds) {}
+
+    void generate(BFMachine& bfMachine) const {
+        auto& state = *bfMachine.state;
+        auto& builder = state.builder;
+        llvm::Value* index = bfMachine.getIndex();
+
+        int maxOffset = 0;
+        for (const auto& term : terms) {
+            maxOffset = std::max(maxOffset, term.offset);
+        }
+        if (checksBounds && maxOffset > 0) {
+            bfMachine.generateCallTapeDoublingFunction(state.CreateAdd(index, state.getConstInt(maxOffset),
+                                                                       "affine loop max offset"));
+        }
+
+        llvm::Value* loopCell = bfMachine.getCurrentChar();
+        llvm::Value* iterations = step == -1 ? loopCell : builder.CreateNeg(loopCell, "affine loop iterations");
+
+        for (const auto& term : terms) {
+            llvm::Value* cellIndex = state.CreateAdd(index, state.getConstInt(term.offset), "affine loop cell");
+            llvm::Value* increment = builder.CreateMul(term.coefficient.generate(bfMachine), iterations);
+            llvm::Value* theChar = bfMachine.getCharAt(cellIndex);
+            bfMachine.setCharAt(cellIndex, state.CreateAdd(theChar, increment, "affine loop add"));
+        }
+
+        bfMachine.setCurrentChar(state.getConstChar(0));
+    }
+
+    [[nodiscard]] char getStep() const { return step; }
+
+    [[nodiscard]] const std::vector<AffineTerm>& getTerms() const { return terms; }
+
+    [[nodiscard]] bool getChecksBounds() const { return checksBounds; }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
 };
 
 class ListExpr {
@@ -169,6 +324,8 @@ public:
             e.generate(bfMachine);
         }
     }
+
+    [[nodiscard]] const std::vector<Expr>& getExprs() const { return v; }
 };
 
 inline Expr getNoOpExpr() {
@@ -178,33 +335,47 @@ inline Expr getNoOpExpr() {
 class WriteToVariable {
 private:
     std::string name;
+    SourceLocation location;
 public:
-    explicit WriteToVariable(std::string name) : name(std::move(name)) {}
+    explicit WriteToVariable(std::string name, SourceLocation location = {})
+        : name(std::move(name)), location(location) {}
 
     void generate(BFMachine& bfMachine) const {
         CompilerState* state = bfMachine.state;
         auto ptr = state->getVariableHandler().getVariablePtr(name);
         state->builder.CreateStore(bfMachine.getCurrentChar(), ptr.pointer);
     }
+
+    [[nodiscard]] const std::string& getName() const { return name; }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
 };
 
 class AssignExpressionValueToTheCurrentCell {
 private:
     Int8Expr variable;
+    SourceLocation location;
 public:
-    explicit AssignExpressionValueToTheCurrentCell(Int8Expr variable): variable(std::move(variable)) {}
+    explicit AssignExpressionValueToTheCurrentCell(Int8Expr variable, SourceLocation location = {})
+        : variable(std::move(variable)), location(location) {}
 
     void generate(BFMachine& bfMachine) const {
         bfMachine.setCurrentChar(variable.generate(bfMachine));
     }
+
+    [[nodiscard]] const Int8Expr& getValue() const { return variable; }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
 };
 
 class IfElse {
 private:
     Expr ifExpr;
     Expr elseExpr;
+    SourceLocation location;
 public:
-    IfElse(Expr ifExpr, Expr elseExpr) : ifExpr(std::move(ifExpr)), elseExpr(std::move(elseExpr)) {}
+    IfElse(Expr ifExpr, Expr elseExpr, SourceLocation location = {})
+        : ifExpr(std::move(ifExpr)), elseExpr(std::move(elseExpr)), location(location) {}
 
     void generate(BFMachine& bfMachine) const {
         auto& state = *bfMachine.state;
@@ -215,29 +386,41 @@ public:
         llvm::BasicBlock* elseBodyBB = state.createBasicBlock("else branch body");
         llvm::BasicBlock* afterBodyBB = state.createBasicBlock("after if/else block");
 
-        builder.CreateCondBr(cond, ifBodyBB, elseBodyBB);
+        state.applyBranchProfile(builder.CreateCondBr(cond, ifBodyBB, elseBodyBB), "if", "else", location);
 
         builder.SetInsertPoint(ifBodyBB);
+        state.countProfileEvent("if", location);
         ifExpr.generate(bfMachine);
         builder.CreateBr(afterBodyBB);
 
         builder.SetInsertPoint(elseBodyBB);
+        state.countProfileEvent("else", location);
         elseExpr.generate(bfMachine);
         builder.CreateBr(afterBodyBB);
 
         builder.SetInsertPoint(afterBodyBB);
     }
+
+    [[nodiscard]] const Expr& getIfExpr() const { return ifExpr; }
+
+    [[nodiscard]] const Expr& getElseExpr() const { return elseExpr; }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
 };
 
 
 class Return {
+private:
+    SourceLocation location;
 public:
+    explicit Return(SourceLocation location = {}) : location(location) {}
+
     void generate(BFMachine& bfMachine) const  {
         auto* state = bfMachine.state;
         auto& builder = state->builder;
         llvm::Value* valueToReturn = bfMachine.getCurrentChar();
 
-        state->clib.generateCallFree(bfMachine.getTape());
+        bfMachine.generateFreeTape();
 
         builder.CreateRet(valueToReturn);
 
@@ -249,6 +432,8 @@ public:
         // every block needs to have a terminating instruction. 0 is arbitrary.
         builder.CreateRet(state->getConstChar(0));
     }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
 };
 
 class BFFunctionDeclaration {
@@ -256,16 +441,20 @@ private:
     std::string functionName;
     std::vector<std::string> argumentNames;
     Expr body;
+    SourceLocation location;
 public:
     BFFunctionDeclaration(std::string functionName,
             std::vector<std::string> variableNames,
-            Expr body): functionName(std::move(functionName)),
+            Expr body,
+            SourceLocation location = {}): functionName(std::move(functionName)),
     argumentNames(std::move(variableNames)),
-    body(std::move(body)) {}
+    body(std::move(body)),
+    location(location) {}
 
     void generate(BFMachine& bfMachine) const {
         CompilerState* state = bfMachine.state;
         auto& builder = state->builder;
+        llvm::TimeRegion timeRegion(state->timeReport != nullptr ? &state->timeReport->getFunctionTimer(*this) : nullptr);
 
         state->pushVariableHandlerStack();
         auto oldBB = builder.GetInsertBlock();
@@ -274,9 +463,13 @@ public:
         std::vector<llvm::Type*> argTypes(argumentNames.size(), builder.getInt8Ty());
 
         llvm::Function* function = state->declareBFFunction(functionName, argTypes);
+        state->applyEntryProfile(function, location);
+        if (state->debugInfo != nullptr)
+            state->debugInfo->beginFunction(builder, function, functionName, location);
 
         llvm::BasicBlock* functionBody = state->createBasicBlock(functionName);
         builder.SetInsertPoint(functionBody);
+        state->countProfileEvent("function", location, functionName);
 
         for (const auto&[argValue, argName] : std::ranges::views::zip(function->args(), argumentNames)) {
             auto argPtr = state->getVariableHandler().getVariablePtr(argName);
@@ -289,24 +482,40 @@ public:
         Return defaultReturn;
         defaultReturn.generate(localBFMachine);
 
-        llvm::EliminateUnreachableBlocks(*function);
+        {
+            PhaseRegion phase(state->timeReport, "unreachable block elimination");
+            llvm::EliminateUnreachableBlocks(*function);
+        }
 
+        if (state->debugInfo != nullptr)
+            state->debugInfo->endFunction(builder);
         state->popVariableHandlerStack();
         state->popFunctionStack();
         builder.SetInsertPoint(oldBB, oldInsertPoint);
     }
+
+    [[nodiscard]] const std::string& getFunctionName() const { return functionName; }
+
+    [[nodiscard]] const std::vector<std::string>& getArgumentNames() const { return argumentNames; }
+
+    [[nodiscard]] const Expr& getBody() const { return body; }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
 };
 
 class BFFunctionCall  {
 private:
     std::string functionName;
     std::vector<Int8Expr> arguments;
+    SourceLocation location;
 public:
-    BFFunctionCall(std::string functionName, std::vector<Int8Expr>&& arguments)
+    BFFunctionCall(std::string functionName, std::vector<Int8Expr>&& arguments, SourceLocation location = {})
         : functionName(std::move(functionName)),
-        arguments(std::move(arguments)) {}
+        arguments(std::move(arguments)),
+        location(location) {}
 
     void generate(BFMachine& bfMachine) const {
+        bfMachine.state->countProfileEvent("call", location, functionName);
 
         auto argValues = arguments | std::ranges::views::transform([&](auto& expr) { return expr.generate(bfMachine) ; }) 
             | std::ranges::to<std::vector>();
@@ -316,6 +525,12 @@ public:
 
         bfMachine.setCurrentChar(returnValue);
     }
+
+    [[nodiscard]] const std::string& getFunctionName() const { return functionName; }
+
+    [[nodiscard]] const std::vector<Int8Expr>& getArguments() const { return arguments; }
+
+    [[nodiscard]] SourceLocation getLocation() const { return location; }
 };
 
 
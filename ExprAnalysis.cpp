@@ -0,0 +1,232 @@
+#include "ExprAnalysis.h"
+
+#include <set>
+
+namespace {
+
+class ConstantEvaluator : public ExprVisitor {
+public:
+    using ExprVisitor::visit;
+
+    std::optional<char> value;
+
+    void visit(const ConstInt8Expr& expr) override {
+        value = expr.getValue();
+    }
+
+    void visit(const MinusInt8Expr& expr) override {
+        expr.getValue().accept(*this);
+        if (value.has_value()) {
+            value = static_cast<char>(-*value);
+        }
+    }
+};
+
+class VariableCollector : public ExprVisitor {
+private:
+    ScopeLayout& layout;
+public:
+    using ExprVisitor::visit;
+
+    explicit VariableCollector(ScopeLayout& layout) : layout(layout) {}
+
+    void visit(const MinusInt8Expr& expr) override { expr.getValue().accept(*this); }
+    void visit(const VariableInt8Expr& expr) override { layout.add(expr.getName()); }
+    void visit(const MovePtrExpr& expr) override { expr.getSteps().accept(*this); }
+    void visit(const AddExpr& expr) override { expr.getAdd().accept(*this); }
+    void visit(const LoopExpr& expr) override { expr.getBody().accept(*this); }
+    void visit(const WriteToVariable& expr) override { layout.add(expr.getName()); }
+    void visit(const AssignExpressionValueToTheCurrentCell& expr) override { expr.getValue().accept(*this); }
+
+    void visit(const AffineLoopExpr& expr) override {
+        for (const auto& term : expr.getTerms()) {
+            term.coefficient.accept(*this);
+        }
+    }
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            e.accept(*this);
+        }
+    }
+
+    void visit(const IfElse& expr) override {
+        expr.getIfExpr().accept(*this);
+        expr.getElseExpr().accept(*this);
+    }
+
+    void visit(const BFFunctionCall& expr) override {
+        for (const auto& argument : expr.getArguments()) {
+            argument.accept(*this);
+        }
+    }
+};
+
+class WriteCollector : public ExprVisitor {
+public:
+    using ExprVisitor::visit;
+
+    std::set<std::string> names;
+
+    void visit(const LoopExpr& expr) override { expr.getBody().accept(*this); }
+    void visit(const WriteToVariable& expr) override { names.insert(expr.getName()); }
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            e.accept(*this);
+        }
+    }
+
+    void visit(const IfElse& expr) override {
+        expr.getIfExpr().accept(*this);
+        expr.getElseExpr().accept(*this);
+    }
+};
+
+class DeclarationCollector : public ExprVisitor {
+private:
+    std::set<std::string> names;
+public:
+    using ExprVisitor::visit;
+
+    std::vector<const BFFunctionDeclaration*> declarations;
+
+    void visit(const LoopExpr& expr) override { expr.getBody().accept(*this); }
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            e.accept(*this);
+        }
+    }
+
+    void visit(const IfElse& expr) override {
+        expr.getIfExpr().accept(*this);
+        expr.getElseExpr().accept(*this);
+    }
+
+    void visit(const BFFunctionDeclaration& expr) override {
+        if (names.insert(expr.getFunctionName()).second) {
+            declarations.push_back(&expr);
+        }
+        expr.getBody().accept(*this);
+    }
+};
+
+class NodeCounter : public ExprVisitor {
+private:
+    void count(const auto& expr) {
+        auto kind = getExprKind(expr);
+        auto it = counts.find(kind);
+        if (it == counts.end())
+            it = counts.emplace(std::string(kind), 0).first;
+        it->second++;
+    }
+public:
+    using ExprVisitor::visit;
+
+    NodeCounts counts;
+
+    void visit(const MinusInt8Expr& expr) override {
+        count(expr);
+        expr.getValue().accept(*this);
+    }
+
+    void visit(const VariableInt8Expr& expr) override { count(expr); }
+    void visit(const ConstInt8Expr& expr) override { count(expr); }
+
+    void visit(const MovePtrExpr& expr) override {
+        count(expr);
+        expr.getSteps().accept(*this);
+    }
+
+    void visit(const AddExpr& expr) override {
+        count(expr);
+        expr.getAdd().accept(*this);
+    }
+
+    void visit(const ReadExpr& expr) override { count(expr); }
+    void visit(const PrintExpr& expr) override { count(expr); }
+    void visit(const PrintIntExpr& expr) override { count(expr); }
+
+    void visit(const LoopExpr& expr) override {
+        count(expr);
+        expr.getBody().accept(*this);
+    }
+
+    void visit(const AffineLoopExpr& expr) override {
+        count(expr);
+        for (const auto& term : expr.getTerms()) {
+            term.coefficient.accept(*this);
+        }
+    }
+
+    void visit(const ListExpr& expr) override {
+        count(expr);
+        for (const auto& e : expr.getExprs()) {
+            e.accept(*this);
+        }
+    }
+
+    void visit(const WriteToVariable& expr) override { count(expr); }
+
+    void visit(const AssignExpressionValueToTheCurrentCell& expr) override {
+        count(expr);
+        expr.getValue().accept(*this);
+    }
+
+    void visit(const IfElse& expr) override {
+        count(expr);
+        expr.getIfExpr().accept(*this);
+        expr.getElseExpr().accept(*this);
+    }
+
+    void visit(const Return& expr) override { count(expr); }
+
+    void visit(const BFFunctionDeclaration& expr) override {
+        count(expr);
+        expr.getBody().accept(*this);
+    }
+
+    void visit(const BFFunctionCall& expr) override {
+        count(expr);
+        for (const auto& argument : expr.getArguments()) {
+            argument.accept(*this);
+        }
+    }
+};
+
+}
+
+std::optional<char> getConstantValue(const Int8Expr& expr) {
+    ConstantEvaluator evaluator;
+    expr.accept(evaluator);
+    return evaluator.value;
+}
+
+ScopeLayout getScopeLayout(const std::vector<std::string>& arguments, const Expr& body) {
+    ScopeLayout layout;
+    for (const auto& argument : arguments) {
+        layout.add(argument);
+    }
+    VariableCollector collector(layout);
+    body.accept(collector);
+    return layout;
+}
+
+std::set<std::string> getWrittenVariables(const Expr& code) {
+    WriteCollector collector;
+    code.accept(collector);
+    return std::move(collector.names);
+}
+
+std::vector<const BFFunctionDeclaration*> getFunctionDeclarations(const Expr& program) {
+    DeclarationCollector collector;
+    program.accept(collector);
+    return collector.declarations;
+}
+
+NodeCounts countNodes(const Expr& expr) {
+    NodeCounter counter;
+    expr.accept(counter);
+    return std::move(counter.counts);
+}
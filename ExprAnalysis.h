@@ -0,0 +1,36 @@
+#pragma once
+
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CompileStats.h"
+#include "Expr.h"
+
+// Returns the value of the expression if it does not depend on variables.
+std::optional<char> getConstantValue(const Int8Expr& expr);
+
+// The variables of a single scope numbered in the order of their first use. The arguments of a function come first.
+struct ScopeLayout {
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> slots;
+
+    void add(const std::string& name) {
+        if (slots.try_emplace(name, static_cast<int>(names.size())).second) {
+            names.push_back(name);
+        }
+    }
+};
+
+// Nested function declarations are not a part of the scope, they have scopes of their own.
+ScopeLayout getScopeLayout(const std::vector<std::string>& arguments, const Expr& body);
+
+// The variables the code writes to, without those of the nested function declarations.
+std::set<std::string> getWrittenVariables(const Expr& code);
+
+// All the function declarations in the order they are generated in. When a name is declared more than once,
+// only the first declaration is returned, as the calls always resolve to it.
+std::vector<const BFFunctionDeclaration*> getFunctionDeclarations(const Expr& program);
+
+NodeCounts countNodes(const Expr& expr);
@@ -0,0 +1,159 @@
+#include "ExprPrinter.h"
+
+namespace {
+
+class ExprPrinter : public ExprVisitor {
+private:
+    void open(const char* name) {
+        out += '(';
+        out += name;
+    }
+
+    void close() {
+        out += ')';
+    }
+
+    void printChild(const Expr& expr) {
+        out += ' ';
+        expr.accept(*this);
+    }
+
+    void printChild(const Int8Expr& expr) {
+        out += ' ';
+        expr.accept(*this);
+    }
+
+    void printName(const std::string& name) {
+        out += ' ';
+        out += name;
+    }
+
+    void printNumber(int value) {
+        out += ' ';
+        out += std::to_string(value);
+    }
+
+    void printPrint(const char* name, const std::optional<char>& knownValue) {
+        open(name);
+        if (knownValue.has_value())
+            printNumber(*knownValue);
+        close();
+    }
+
+public:
+    using ExprVisitor::visit;
+
+    std::string out;
+
+    void visit(const MinusInt8Expr& expr) override {
+        open("minus");
+        printChild(expr.getValue());
+        close();
+    }
+
+    void visit(const VariableInt8Expr& expr) override {
+        open("var");
+        printName(expr.getName());
+        close();
+    }
+
+    void visit(const ConstInt8Expr& expr) override {
+        out += std::to_string(static_cast<int>(expr.getValue()));
+    }
+
+    void visit(const MovePtrExpr& expr) override {
+        open(expr.getChecksBounds() ? "move" : "unchecked-move");
+        printChild(expr.getSteps());
+        close();
+    }
+
+    void visit(const AddExpr& expr) override {
+        open("add");
+        printChild(expr.getAdd());
+        close();
+    }
+
+    void visit(const ReadExpr&) override { out += "(read)"; }
+    void visit(const PrintExpr& expr) override { printPrint("print", expr.getKnownValue()); }
+    void visit(const PrintIntExpr& expr) override { printPrint("print-int", expr.getKnownValue()); }
+
+    void visit(const LoopExpr& expr) override {
+        open("loop");
+        if (const auto& check = expr.getBoundsCheck()) {
+            printName(check->perIteration ? "check-every" : "check-before");
+            printNumber(check->maxOffset);
+        }
+        printChild(expr.getBody());
+        close();
+    }
+
+    void visit(const AffineLoopExpr& expr) override {
+        open(expr.getChecksBounds() ? "affine-loop" : "unchecked-affine-loop");
+        printNumber(expr.getStep());
+        for (const auto& term : expr.getTerms()) {
+            out += " (";
+            out += std::to_string(term.offset);
+            printChild(term.coefficient);
+            close();
+        }
+        close();
+    }
+
+    void visit(const ListExpr& expr) override {
+        open("list");
+        for (const auto& e : expr.getExprs()) {
+            printChild(e);
+        }
+        close();
+    }
+
+    void visit(const WriteToVariable& expr) override {
+        open("store");
+        printName(expr.getName());
+        close();
+    }
+
+    void visit(const AssignExpressionValueToTheCurrentCell& expr) override {
+        open("assign");
+        printChild(expr.getValue());
+        close();
+    }
+
+    void visit(const IfElse& expr) override {
+        open("if");
+        printChild(expr.getIfExpr());
+        printChild(expr.getElseExpr());
+        close();
+    }
+
+    void visit(const Return&) override { out += "(return)"; }
+
+    void visit(const BFFunctionDeclaration& expr) override {
+        open("function");
+        printName(expr.getFunctionName());
+        out += " (";
+        for (const auto& argument : expr.getArgumentNames()) {
+            printName(argument);
+        }
+        close();
+        printChild(expr.getBody());
+        close();
+    }
+
+    void visit(const BFFunctionCall& expr) override {
+        open("call");
+        printName(expr.getFunctionName());
+        for (const auto& argument : expr.getArguments()) {
+            printChild(argument);
+        }
+        close();
+    }
+};
+
+}
+
+std::string printExpr(const Expr& expr) {
+    ExprPrinter printer;
+    expr.accept(printer);
+    return printer.out;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+#include "Expr.h"
+
+// Prints the tree as an s-expression, so that two trees print the same exactly when they are the same.
+std::string printExpr(const Expr& expr);
@@ -0,0 +1,116 @@
+#include "ExprRewriter.h"
+
+void ExprRewriter::setResult(Expr expr) {
+    exprResult.emplace(std::move(expr));
+}
+
+void ExprRewriter::setResult(Int8Expr expr) {
+    int8ExprResult.emplace(std::move(expr));
+}
+
+Expr ExprRewriter::rewrite(const Expr& expr) {
+    expr.accept(*this);
+    Expr result = std::move(*exprResult);
+    exprResult.reset();
+    return result;
+}
+
+Int8Expr ExprRewriter::rewrite(const Int8Expr& expr) {
+    expr.accept(*this);
+    Int8Expr result = std::move(*int8ExprResult);
+    int8ExprResult.reset();
+    return result;
+}
+
+Expr ExprRewriter::rewrite(const BFFunctionDeclaration& expr) {
+    visit(expr);
+    Expr result = std::move(*exprResult);
+    exprResult.reset();
+    return result;
+}
+
+void ExprRewriter::visit(const MinusInt8Expr& expr) {
+    setResult(mkInt8Expr<MinusInt8Expr>(rewrite(expr.getValue())));
+}
+
+void ExprRewriter::visit(const VariableInt8Expr& expr) {
+    setResult(mkInt8Expr<VariableInt8Expr>(expr.getName()));
+}
+
+void ExprRewriter::visit(const ConstInt8Expr& expr) {
+    setResult(mkInt8Expr<ConstInt8Expr>(expr.getValue()));
+}
+
+void ExprRewriter::visit(const MovePtrExpr& expr) {
+    setResult(mkExpr<MovePtrExpr>(rewrite(expr.getSteps()), expr.getLocation(), expr.getChecksBounds()));
+}
+
+void ExprRewriter::visit(const AddExpr& expr) {
+    setResult(mkExpr<AddExpr>(rewrite(expr.getAdd()), expr.getLocation()));
+}
+
+void ExprRewriter::visit(const ReadExpr& expr) {
+    setResult(mkExpr<ReadExpr>(expr.getLocation()));
+}
+
+void ExprRewriter::visit(const PrintExpr& expr) {
+    setResult(mkExpr<PrintExpr>(expr.getLocation(), expr.getKnownValue()));
+}
+
+void ExprRewriter::visit(const PrintIntExpr& expr) {
+    setResult(mkExpr<PrintIntExpr>(expr.getLocation(), expr.getKnownValue()));
+}
+
+void ExprRewriter::visit(const LoopExpr& expr) {
+    setResult(mkExpr<LoopExpr>(rewrite(expr.getBody()), expr.getLocation(), expr.getBoundsCheck()));
+}
+
+void ExprRewriter::visit(const AffineLoopExpr& expr) {
+    std::vector<AffineTerm> terms;
+    for (const auto& term : expr.getTerms()) {
+        terms.push_back({term.offset, rewrite(term.coefficient)});
+    }
+    setResult(mkExpr<AffineLoopExpr>(expr.getStep(), std::move(terms), expr.getLocation(),
+                                     expr.getChecksBounds()));
+}
+
+void ExprRewriter::visit(const ListExpr& expr) {
+    std::vector<Expr> exprs;
+    for (const auto& e : expr.getExprs()) {
+        exprs.push_back(rewrite(e));
+    }
+    setResult(mkExpr<ListExpr>(std::move(exprs)));
+}
+
+void ExprRewriter::visit(const WriteToVariable& expr) {
+    setResult(mkExpr<WriteToVariable>(expr.getName(), expr.getLocation()));
+}
+
+void ExprRewriter::visit(const AssignExpressionValueToTheCurrentCell& expr) {
+    setResult(mkExpr<AssignExpressionValueToTheCurrentCell>(rewrite(expr.getValue()), expr.getLocation()));
+}
+
+void ExprRewriter::visit(const IfElse& expr) {
+    auto ifExpr = rewrite(expr.getIfExpr());
+    auto elseExpr = rewrite(expr.getElseExpr());
+    setResult(mkExpr<IfElse>(std::move(ifExpr), std::move(elseExpr), expr.getLocation()));
+}
+
+void ExprRewriter::visit(const Return& expr) {
+    setResult(mkExpr<Return>(expr.getLocation()));
+}
+
+void ExprRewriter::visit(const BFFunctionDeclaration& expr) {
+    setResult(mkExpr<BFFunctionDeclaration>(expr.getFunctionName(),
+                                            expr.getArgumentNames(),
+                                            rewrite(expr.getBody()),
+                                            expr.getLocation()));
+}
+
+void ExprRewriter::visit(const BFFunctionCall& expr) {
+    std::vector<Int8Expr> arguments;
+    for (const auto& argument : expr.getArguments()) {
+        arguments.push_back(rewrite(argument));
+    }
+    setResult(mkExpr<BFFunctionCall>(expr.getFunctionName(), std::move(arguments), expr.getLocation()));
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <optional>
+#include "Expr.h"
+
+// Rebuilds the tree it is applied to. A pass overrides the visit methods for the nodes it transforms and
+// relies on the default ones to copy everything else.
+class ExprRewriter : public ExprVisitor {
+private:
+    std::optional<Expr> exprResult;
+    std::optional<Int8Expr> int8ExprResult;
+
+protected:
+    void setResult(Expr expr);
+
+    void setResult(Int8Expr expr);
+
+public:
+    Expr rewrite(const Expr& expr);
+
+    Int8Expr rewrite(const Int8Expr& expr);
+
+    // For a declaration reached without the Expr holding it, which cannot be copied.
+    Expr rewrite(const BFFunctionDeclaration& expr);
+
+    void visit(const MinusInt8Expr& expr) override;
+    void visit(const VariableInt8Expr& expr) override;
+    void visit(const ConstInt8Expr& expr) override;
+    void visit(const MovePtrExpr& expr) override;
+    void visit(const AddExpr& expr) override;
+    void visit(const ReadExpr& expr) override;
+    void visit(const PrintExpr& expr) override;
+    void visit(const PrintIntExpr& expr) override;
+    void visit(const LoopExpr& expr) override;
+    void visit(const AffineLoopExpr& expr) override;
+    void visit(const ListExpr& expr) override;
+    void visit(const WriteToVariable& expr) override;
+    void visit(const AssignExpressionValueToTheCurrentCell& expr) override;
+    void visit(const IfElse& expr) override;
+    void visit(const Return& expr) override;
+    void visit(const BFFunctionDeclaration& expr) override;
+    void visit(const BFFunctionCall& expr) override;
+};
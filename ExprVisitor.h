@@ -0,0 +1,45 @@
+#pragma once
+
+class MinusInt8Expr;
+class VariableInt8Expr;
+class ConstInt8Expr;
+class MovePtrExpr;
+class AddExpr;
+class ReadExpr;
+class PrintExpr;
+class PrintIntExpr;
+class LoopExpr;
+class AffineLoopExpr;
+class ListExpr;
+class WriteToVariable;
+class AssignExpressionValueToTheCurrentCell;
+class IfElse;
+class Return;
+class BFFunctionDeclaration;
+class BFFunctionCall;
+
+// Every node the visitor does not override ends up in visitDefault.
+class ExprVisitor {
+protected:
+    virtual void visitDefault() {}
+public:
+    virtual ~ExprVisitor() = default;
+
+    virtual void visit(const MinusInt8Expr&) { visitDefault(); }
+    virtual void visit(const VariableInt8Expr&) { visitDefault(); }
+    virtual void visit(const ConstInt8Expr&) { visitDefault(); }
+    virtual void visit(const MovePtrExpr&) { visitDefault(); }
+    virtual void visit(const AddExpr&) { visitDefault(); }
+    virtual void visit(const ReadExpr&) { visitDefault(); }
+    virtual void visit(const PrintExpr&) { visitDefault(); }
+    virtual void visit(const PrintIntExpr&) { visitDefault(); }
+    virtual void visit(const LoopExpr&) { visitDefault(); }
+    virtual void visit(const AffineLoopExpr&) { visitDefault(); }
+    virtual void visit(const ListExpr&) { visitDefault(); }
+    virtual void visit(const WriteToVariable&) { visitDefault(); }
+    virtual void visit(const AssignExpressionValueToTheCurrentCell&) { visitDefault(); }
+    virtual void visit(const IfElse&) { visitDefault(); }
+    virtual void visit(const Return&) { visitDefault(); }
+    virtual void visit(const BFFunctionDeclaration&) { visitDefault(); }
+    virtual void visit(const BFFunctionCall&) { visitDefault(); }
+};
@@ -0,0 +1,191 @@
+#include "IncrementalCompiler.h"
+#include "ExprAnalysis.h"
+#include "ExprPrinter.h"
+#include "ExprRewriter.h"
+#include "PassPipeline.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+// Bump whenever the generated code of a unit changes for the same key.
+constexpr std::string_view kUnitFormatVersion = "9";
+
+// A nested declaration is a unit of its own, so the enclosing unit keeps only the calls to it.
+class DeclarationStripper : public ExprRewriter {
+public:
+    using ExprRewriter::visit;
+
+    void visit(const BFFunctionDeclaration&) override {
+        setResult(mkExpr<ListExpr>(std::vector<Expr>{}));
+    }
+};
+
+class CallCollector : public ExprVisitor {
+public:
+    using ExprVisitor::visit;
+
+    std::set<std::string> callees;
+
+    void visit(const LoopExpr& expr) override { expr.getBody().accept(*this); }
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            e.accept(*this);
+        }
+    }
+
+    void visit(const IfElse& expr) override {
+        expr.getIfExpr().accept(*this);
+        expr.getElseExpr().accept(*this);
+    }
+
+    void visit(const BFFunctionCall& expr) override { callees.insert(expr.getFunctionName()); }
+};
+
+// Either the main program or a single function.
+struct Unit {
+    const BFFunctionDeclaration* declaration;
+    Expr code;
+    std::set<std::string> callees;
+};
+
+Unit createUnit(Expr code, const BFFunctionDeclaration* declaration) {
+    CallCollector collector;
+    code.accept(collector);
+    return {declaration, std::move(code), std::move(collector.callees)};
+}
+
+Unit createMainUnit(const Expr& program) {
+    return createUnit(DeclarationStripper().rewrite(program), nullptr);
+}
+
+Unit createFunctionUnit(const BFFunctionDeclaration& declaration) {
+    auto code = mkExpr<BFFunctionDeclaration>(declaration.getFunctionName(), declaration.getArgumentNames(),
+                                              DeclarationStripper().rewrite(declaration.getBody()),
+                                              declaration.getLocation());
+    return createUnit(std::move(code), &declaration);
+}
+
+class IncrementalCompiler {
+private:
+    const CompilationCache& cache;
+    std::string_view targetTriple;
+    int tapeSize;
+    TapeGrowth tapeGrowth;
+    int optLevel;
+    std::map<std::string, const BFFunctionDeclaration*> functions;
+
+    [[nodiscard]] int getArity(const std::string& function) const {
+        return static_cast<int>(functions.at(function)->getArgumentNames().size());
+    }
+
+    [[nodiscard]] std::string getUnitKey(const Unit& unit) const {
+        llvm::SHA256 hasher;
+        auto addField = [&](std::string_view field) {
+            hasher.update(llvm::StringRef(field.data(), field.size()));
+            hasher.update(llvm::StringRef("\0", 1));
+        };
+        addField(kUnitFormatVersion);
+        addField(LLVM_VERSION_STRING);
+        addField(targetTriple);
+        addField(std::to_string(tapeSize));
+        addField(std::to_string(tapeGrowth.factor));
+        addField(std::to_string(tapeGrowth.minimumStep));
+        addField(std::to_string(optLevel));
+        addField(printExpr(unit.code));
+        for (const auto& callee : unit.callees) {
+            addField(callee);
+            addField(std::to_string(getArity(callee)));
+        }
+        return llvm::toHex(hasher.final(), /*LowerCase=*/true) + ".bc";
+    }
+
+    [[nodiscard]] llvm::SmallVector<char, 0> generateUnit(const Unit& unit) const {
+        auto state = initCompilerState("unit", targetTriple, tapeGrowth);
+        auto& builder = state->builder;
+        for (const auto& callee : unit.callees) {
+            if (unit.declaration == nullptr || callee != unit.declaration->getFunctionName()) {
+                std::vector<llvm::Type*> argTypes(getArity(callee), builder.getInt8Ty());
+                state->clib.declareFunction(argTypes, builder.getInt8Ty(), false, callee);
+            }
+        }
+
+        BFMachine bfMachine = createBFMachine(state.get(), tapeSize);
+        unit.code.generate(bfMachine);
+        if (unit.declaration == nullptr) {
+            state->finalize();
+        } else {
+            // The main program of a function unit is only there to host the generation.
+            state->module.getFunction("main")->eraseFromParent();
+        }
+        runOptimizationPipeline(state->module, optLevel);
+
+        llvm::SmallVector<char, 0> bitcode;
+        llvm::raw_svector_ostream out(bitcode);
+        llvm::WriteBitcodeToFile(state->module, out);
+        return bitcode;
+    }
+
+public:
+    IncrementalCompiler(const CompilationCache& cache, std::string_view targetTriple, int tapeSize,
+                        TapeGrowth tapeGrowth, int optLevel,
+                        const std::vector<const BFFunctionDeclaration*>& declarations)
+            : cache(cache), targetTriple(targetTriple), tapeSize(tapeSize), tapeGrowth(tapeGrowth),
+              optLevel(optLevel) {
+        for (const auto* declaration : declarations) {
+            functions.emplace(declaration->getFunctionName(), declaration);
+        }
+    }
+
+    std::unique_ptr<llvm::Module> load(const Unit& unit, llvm::LLVMContext& context) const {
+        auto key = getUnitKey(unit);
+        if (auto cached = cache.load(key)) {
+            auto module = llvm::parseBitcodeFile(cached->getMemBufferRef(), context);
+            if (module)
+                return std::move(*module);
+            // A corrupted entry is simply generated again.
+            llvm::consumeError(module.takeError());
+        }
+
+        auto bitcode = generateUnit(unit);
+        llvm::StringRef contents(bitcode.data(), bitcode.size());
+        cache.store(key, contents);
+        return llvm::cantFail(llvm::parseBitcodeFile(llvm::MemoryBufferRef(contents, key), context));
+    }
+};
+
+}
+
+bool compileIncrementally(const Expr& program, const CompilationCache& cache, const std::string& moduleName,
+                          std::string_view targetTriple, int tapeSize, TapeGrowth tapeGrowth, int optLevel,
+                          const std::string& outputPath) {
+    auto declarations = getFunctionDeclarations(program);
+    IncrementalCompiler compiler(cache, targetTriple, tapeSize, tapeGrowth, optLevel, declarations);
+
+    llvm::LLVMContext context;
+    auto module = compiler.load(createMainUnit(program), context);
+    for (const auto* declaration : declarations) {
+        if (llvm::Linker::linkModules(*module, compiler.load(createFunctionUnit(*declaration), context)))
+            return false;
+    }
+    module->setModuleIdentifier(moduleName);
+    module->setSourceFileName(moduleName);
+
+    std::error_code error;
+    llvm::raw_fd_ostream out(outputPath, error);
+    if (error)
+        return false;
+    module->print(out, nullptr);
+    return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "CompilationCache.h"
+#include "Expr.h"
+
+// Compiles the main program and every function into a module of its own and links the modules into the output.
+// The optimised modules are cached as bitcode, keyed by their code and the signatures of the functions they call,
+// so after an edit only the changed units are generated and optimised again. Returns false if the modules could
+// not be linked or the output could not be written.
+bool compileIncrementally(const Expr& program, const CompilationCache& cache, const std::string& moduleName,
+                          std::string_view targetTriple, int tapeSize, TapeGrowth tapeGrowth, int optLevel,
+                          const std::string& outputPath);
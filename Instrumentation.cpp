@@ -0,0 +1,91 @@
+#include "Instrumentation.h"
+#include "CompilerState.h"
+
+#include <format>
+
+void Instrumentation::count(CompilerState& state, std::string_view kind, SourceLocation location,
+                            std::string_view name) {
+    auto& builder = state.builder;
+    auto* int64Ty = builder.getInt64Ty();
+    if (counters == nullptr) {
+        counters = new llvm::GlobalVariable(state.module, int64Ty, false, llvm::GlobalValue::ExternalLinkage,
+                                            nullptr, "yabfpp.counters.placeholder");
+    }
+    auto* counter = builder.CreateConstInBoundsGEP1_64(int64Ty, counters, sites.size(), "profile counter");
+    auto* incremented = builder.CreateAdd(builder.CreateLoad(Pointer{int64Ty, counter}), builder.getInt64(1),
+                                          "count profile event");
+    builder.CreateStore(incremented, counter);
+    sites.push_back(std::format("{} {} {} {}", kind, location.line, location.column, name));
+}
+
+llvm::Function* Instrumentation::generateProfileWriter(CompilerState& state, llvm::GlobalVariable* counterArray) {
+    auto& module = state.module;
+    auto& builder = state.builder;
+    auto* ptrTy = state.getPtrTy();
+    auto* int64Ty = builder.getInt64Ty();
+
+    std::vector<llvm::Constant*> siteStrings;
+    for (const auto& site : sites) {
+        siteStrings.push_back(builder.CreateGlobalString(site, "profile site", 0, &module));
+    }
+    auto* sitesTy = llvm::ArrayType::get(ptrTy, sites.size());
+    auto* siteArray = new llvm::GlobalVariable(module, sitesTy, true, llvm::GlobalValue::PrivateLinkage,
+                                               llvm::ConstantArray::get(sitesTy, siteStrings), "yabfpp.profile.sites");
+
+    auto fopen = module.getOrInsertFunction("fopen", ptrTy, ptrTy, ptrTy);
+    auto fprintf = module.getOrInsertFunction("fprintf", llvm::FunctionType::get(builder.getInt32Ty(),
+                                                                                 {ptrTy, ptrTy}, true));
+    auto fclose = module.getOrInsertFunction("fclose", builder.getInt32Ty(), ptrTy);
+
+    auto* writer = llvm::Function::Create(llvm::FunctionType::get(builder.getVoidTy(), false),
+                                          llvm::GlobalValue::InternalLinkage, "yabfpp.writeProfile", module);
+    auto* entryBB = state.createBasicBlock("write profile", writer);
+    auto* loopBB = state.createBasicBlock("write profile counter", writer);
+    auto* closeBB = state.createBasicBlock("close profile", writer);
+    auto* exitBB = state.createBasicBlock("profile written", writer);
+
+    builder.SetInsertPoint(entryBB);
+    auto* file = builder.CreateCall(fopen, {builder.CreateGlobalString(profilePath, "profile path", 0, &module),
+                                            builder.CreateGlobalString("w", "profile mode", 0, &module)});
+    builder.CreateCondBr(builder.CreateIsNull(file, "cannot open profile"), exitBB, loopBB);
+
+    builder.SetInsertPoint(loopBB);
+    auto* index = builder.CreatePHI(int64Ty, 2, "profile counter index");
+    index->addIncoming(builder.getInt64(0), entryBB);
+    auto* site = builder.CreateLoad(Pointer{ptrTy, builder.CreateInBoundsGEP(ptrTy, siteArray, index)});
+    auto* count = builder.CreateLoad(Pointer{int64Ty, builder.CreateInBoundsGEP(int64Ty, counterArray, index)});
+    builder.CreateCall(fprintf, {file, builder.CreateGlobalString("%s %llu\n", "profile line", 0, &module), site,
+                                 count});
+    auto* next = builder.CreateAdd(index, builder.getInt64(1), "next profile counter");
+    index->addIncoming(next, loopBB);
+    builder.CreateCondBr(builder.CreateICmpULT(next, builder.getInt64(sites.size())), loopBB, closeBB);
+
+    builder.SetInsertPoint(closeBB);
+    builder.CreateCall(fclose, {file});
+    builder.CreateBr(exitBB);
+
+    builder.SetInsertPoint(exitBB);
+    builder.CreateRetVoid();
+    return writer;
+}
+
+void Instrumentation::finalize(CompilerState& state) {
+    if (counters == nullptr)
+        return;
+    auto& module = state.module;
+    auto& builder = state.builder;
+
+    auto* countersTy = llvm::ArrayType::get(builder.getInt64Ty(), sites.size());
+    auto* counterArray = new llvm::GlobalVariable(module, countersTy, false, llvm::GlobalValue::InternalLinkage,
+                                                  llvm::ConstantAggregateZero::get(countersTy), "yabfpp.counters");
+    counters->replaceAllUsesWith(counterArray);
+    counters->eraseFromParent();
+    counters = nullptr;
+
+    auto* writer = generateProfileWriter(state, counterArray);
+
+    auto atexit = module.getOrInsertFunction("atexit", builder.getInt32Ty(), state.getPtrTy());
+    auto& mainEntry = module.getFunction("main")->getEntryBlock();
+    builder.SetInsertPoint(&mainEntry, mainEntry.getFirstInsertionPt());
+    builder.CreateCall(atexit, {writer});
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Source.h"
+#include "llvm/IR/GlobalVariable.h"
+
+class CompilerState;
+
+// Counts how often the loops iterate and exit, the branches are taken and the functions are called. At exit the program
+// writes its counters to the profile, a line per counter: the kind of the event, the line and the column of the
+// construct in the source, the name of the function or "-", and the count.
+class Instrumentation {
+private:
+    std::string profilePath;
+    std::vector<std::string> sites;
+    // Stands for the array of the counters until its size is known.
+    llvm::GlobalVariable* counters = nullptr;
+
+    llvm::Function* generateProfileWriter(CompilerState& state, llvm::GlobalVariable* counterArray);
+public:
+    explicit Instrumentation(std::string profilePath) : profilePath(std::move(profilePath)) {}
+
+    void count(CompilerState& state, std::string_view kind, SourceLocation location, std::string_view name);
+
+    // Allocates the counters and registers the writing of the profile at exit. Call after CompilerState::finalize.
+    void finalize(CompilerState& state);
+};
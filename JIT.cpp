@@ -0,0 +1,71 @@
+#include "JIT.h"
+#include "PassPipeline.h"
+
+#include <cstdio>
+#include <print>
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/Support/TargetSelect.h>
+
+// The module of CompilerState lives in the state's context, while the JIT needs one it can own.
+static std::unique_ptr<llvm::Module> cloneToContext(const llvm::Module& module, llvm::LLVMContext& context) {
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::raw_svector_ostream out(bitcode);
+    llvm::WriteBitcodeToFile(module, out);
+    llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), module.getModuleIdentifier());
+    return llvm::cantFail(llvm::parseBitcodeFile(buffer, context));
+}
+
+llvm::Expected<llvm::orc::ExecutorAddr> JIT::addAndLookup(const CompilerState& state, llvm::StringRef symbol) {
+    auto unit = jit->createJITDylib("unit" + std::to_string(unitCount++));
+    if (!unit)
+        return unit.takeError();
+
+    auto generator = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            jit->getDataLayout().getGlobalPrefix());
+    if (!generator)
+        return generator.takeError();
+    unit->addGenerator(std::move(*generator));
+
+    auto context = std::make_unique<llvm::LLVMContext>();
+    auto module = cloneToContext(state.module, *context);
+    module->setTargetTriple(jit->getTargetTriple());
+    module->setDataLayout(jit->getDataLayout());
+    runOptimizationPipeline(*module, optLevel);
+
+    if (auto error = jit->addIRModule(*unit, llvm::orc::ThreadSafeModule(std::move(module), std::move(context))))
+        return error;
+
+    return jit->lookup(*unit, symbol);
+}
+
+llvm::Expected<std::unique_ptr<JIT>> createJIT(int optLevel) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    auto jit = llvm::orc::LLJITBuilder().create();
+    if (!jit)
+        return jit.takeError();
+    return std::make_unique<JIT>(std::move(*jit), optLevel);
+}
+
+static int reportError(llvm::Error error) {
+    std::println("JIT error: {}", llvm::toString(std::move(error)));
+    return 1;
+}
+
+int runWithJIT(const CompilerState& state, int optLevel) {
+    auto jit = createJIT(optLevel);
+    if (!jit)
+        return reportError(jit.takeError());
+
+    auto mainAddress = (*jit)->addAndLookup(state, "main");
+    if (!mainAddress)
+        return reportError(mainAddress.takeError());
+
+    int result = mainAddress->toPtr<int (*)()>()();
+    std::fflush(stdout);
+    return result;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <memory>
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+
+#include "CompilerState.h"
+
+class JIT {
+private:
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+    int optLevel;
+    int unitCount = 0;
+
+public:
+    JIT(std::unique_ptr<llvm::orc::LLJIT> jit, int optLevel) : jit(std::move(jit)), optLevel(optLevel) {}
+
+    // Compiles the finalized module of the state into a unit of its own, so that the helper functions of
+    // different units never clash, and returns the address of the symbol in it. The C library functions the
+    // module calls are resolved from this process.
+    llvm::Expected<llvm::orc::ExecutorAddr> addAndLookup(const CompilerState& state, llvm::StringRef symbol);
+};
+
+llvm::Expected<std::unique_ptr<JIT>> createJIT(int optLevel);
+
+// Compiles the finalized module of the state and runs its main in this process.
+int runWithJIT(const CompilerState& state, int optLevel);
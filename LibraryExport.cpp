@@ -0,0 +1,335 @@
+#include "LibraryExport.h"
+#include "CompilerState.h"
+
+#include <cctype>
+#include <filesystem>
+#include <format>
+#include <map>
+#include <set>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/IR/InstIterator.h>
+
+namespace {
+
+// The fields of the context: the rest of the input, the output buffer and the length of the output so far, which may
+// exceed the capacity.
+enum ContextField : unsigned {
+    kInput,
+    kInputEnd,
+    kOutput,
+    kOutputCapacity,
+    kOutputLength,
+};
+
+// What the program calls to read and write, replaced by the functions reading and writing the buffers.
+const std::vector<std::string> kIOFunctions = {"readChar", "putchar", "printf"};
+
+class LibraryGenerator {
+private:
+    CompilerState& state;
+    llvm::IntegerType* sizeTy;
+    llvm::StructType* contextTy;
+
+    llvm::Value* getField(llvm::Value* context, ContextField field) {
+        return state.builder.CreateStructGEP(contextTy, context, field);
+    }
+
+    llvm::Value* loadField(llvm::Value* context, ContextField field) {
+        return state.builder.CreateLoad(Pointer{contextTy->getElementType(field), getField(context, field)});
+    }
+
+    llvm::Function* createInternalFunction(llvm::Type* result, llvm::ArrayRef<llvm::Type*> params,
+                                           const std::string& name) {
+        return llvm::Function::Create(llvm::FunctionType::get(result, params, false),
+                                      llvm::GlobalValue::InternalLinkage, name, state.module);
+    }
+
+    llvm::Function* generateReadChar();
+
+    llvm::Function* generateWriteChar();
+
+    llvm::Function* generatePrintInt(llvm::Function* writeChar);
+
+    std::vector<llvm::Function*> findFunctionsDoingIO();
+
+    void passContext(const std::vector<llvm::Function*>& functions, const std::map<std::string, llvm::Function*>& io);
+
+    void generateEntryPoint(llvm::Function* program, const std::string& symbol);
+public:
+    explicit LibraryGenerator(CompilerState& state)
+            : state(state),
+              sizeTy(state.clib.getSizeTy()),
+              contextTy(llvm::StructType::create(state.module.getContext(),
+                                                 {state.getPtrTy(), state.getPtrTy(), state.getPtrTy(), sizeTy,
+                                                  sizeTy}, "yabfpp.lib.context")) {}
+
+    void generate(const std::string& symbol);
+};
+
+llvm::Function* LibraryGenerator::generateReadChar() {
+    auto& builder = state.builder;
+    auto* readChar = createInternalFunction(builder.getInt8Ty(), {state.getPtrTy()}, "yabfpp.lib.readChar");
+    auto* context = readChar->getArg(0);
+    auto* entryBB = state.createBasicBlock("read input char", readChar);
+    auto* endBB = state.createBasicBlock("end of input", readChar);
+    auto* charBB = state.createBasicBlock("input char", readChar);
+
+    builder.SetInsertPoint(entryBB);
+    auto* input = loadField(context, kInput);
+    auto* inputEnd = loadField(context, kInputEnd);
+    builder.CreateCondBr(builder.CreateICmpEQ(input, inputEnd, "is end of input"), endBB, charBB);
+
+    builder.SetInsertPoint(endBB);
+    // What readChar returns on EOF.
+    builder.CreateRet(state.getConstChar(0));
+
+    builder.SetInsertPoint(charBB);
+    auto* theChar = builder.CreateLoad(Pointer{builder.getInt8Ty(), input});
+    builder.CreateStore(builder.CreateConstInBoundsGEP1_64(builder.getInt8Ty(), input, 1),
+                        getField(context, kInput));
+    builder.CreateRet(theChar);
+    return readChar;
+}
+
+llvm::Function* LibraryGenerator::generateWriteChar() {
+    auto& builder = state.builder;
+    auto* writeChar = createInternalFunction(builder.getVoidTy(), {state.getPtrTy(), builder.getInt8Ty()},
+                                             "yabfpp.lib.writeChar");
+    auto* context = writeChar->getArg(0);
+    auto* entryBB = state.createBasicBlock("write output char", writeChar);
+    auto* storeBB = state.createBasicBlock("output fits", writeChar);
+    auto* countBB = state.createBasicBlock("count output char", writeChar);
+
+    builder.SetInsertPoint(entryBB);
+    auto* outputLength = loadField(context, kOutputLength);
+    auto* fits = builder.CreateICmpULT(outputLength, loadField(context, kOutputCapacity), "does output fit");
+    builder.CreateCondBr(fits, storeBB, countBB);
+
+    builder.SetInsertPoint(storeBB);
+    builder.CreateStore(writeChar->getArg(1),
+                        builder.CreateInBoundsGEP(builder.getInt8Ty(), loadField(context, kOutput), outputLength));
+    builder.CreateBr(countBB);
+
+    // The output which does not fit is still counted, so that the caller learns the capacity it needs.
+    builder.SetInsertPoint(countBB);
+    builder.CreateStore(builder.CreateAdd(outputLength, llvm::ConstantInt::get(sizeTy, 1)),
+                        getField(context, kOutputLength));
+    builder.CreateRetVoid();
+    return writeChar;
+}
+
+llvm::Function* LibraryGenerator::generatePrintInt(llvm::Function* writeChar) {
+    auto& module = state.module;
+    auto& builder = state.builder;
+    auto* ptrTy = state.getPtrTy();
+    auto* int32Ty = builder.getInt32Ty();
+    auto snprintf = module.getOrInsertFunction("snprintf",
+                                               llvm::FunctionType::get(int32Ty, {ptrTy, sizeTy, ptrTy}, true));
+    auto* printInt = createInternalFunction(builder.getVoidTy(), {ptrTy, ptrTy, int32Ty}, "yabfpp.lib.printInt");
+    auto* entryBB = state.createBasicBlock("print int", printInt);
+    auto* copyBB = state.createBasicBlock("copy printed char", printInt);
+    auto* exitBB = state.createBasicBlock("int printed", printInt);
+
+    // Large enough for any int and the newline the format ends with, which also makes the length at least 1.
+    constexpr int kBufferSize = 16;
+    builder.SetInsertPoint(entryBB);
+    auto* buffer = builder.CreateAlloca(llvm::ArrayType::get(builder.getInt8Ty(), kBufferSize), nullptr,
+                                        "printed int");
+    auto* length = builder.CreateCall(snprintf, {buffer, llvm::ConstantInt::get(sizeTy, kBufferSize),
+                                                 printInt->getArg(1), printInt->getArg(2)});
+    builder.CreateBr(copyBB);
+
+    builder.SetInsertPoint(copyBB);
+    auto* index = builder.CreatePHI(int32Ty, 2, "printed char index");
+    index->addIncoming(builder.getInt32(0), entryBB);
+    auto* theChar = builder.CreateLoad(Pointer{builder.getInt8Ty(),
+                                               builder.CreateInBoundsGEP(builder.getInt8Ty(), buffer, index)});
+    builder.CreateCall(writeChar, {printInt->getArg(0), theChar});
+    auto* next = builder.CreateAdd(index, builder.getInt32(1));
+    index->addIncoming(next, copyBB);
+    builder.CreateCondBr(builder.CreateICmpSLT(next, length), copyBB, exitBB);
+
+    builder.SetInsertPoint(exitBB);
+    builder.CreateRetVoid();
+    return printInt;
+}
+
+std::vector<llvm::Function*> LibraryGenerator::findFunctionsDoingIO() {
+    std::set<llvm::Function*> doesIO;
+    for (const auto& name : kIOFunctions) {
+        if (auto* function = state.module.getFunction(name))
+            doesIO.insert(function);
+    }
+    // main gets the context even if it does no I/O, so that the entry point calls every program alike.
+    std::vector<llvm::Function*> functions = {state.module.getFunction("main")};
+    doesIO.insert(functions.front());
+
+    // A function calling a function doing I/O does I/O itself.
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto& function : state.module) {
+            if (function.isDeclaration() || doesIO.contains(&function))
+                continue;
+            bool callsIO = llvm::any_of(llvm::instructions(function), [&](const llvm::Instruction& instruction) {
+                auto* call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+                return call != nullptr && doesIO.contains(call->getCalledFunction());
+            });
+            if (callsIO) {
+                doesIO.insert(&function);
+                functions.push_back(&function);
+                changed = true;
+            }
+        }
+    }
+    return functions;
+}
+
+void LibraryGenerator::passContext(const std::vector<llvm::Function*>& functions,
+                                   const std::map<std::string, llvm::Function*>& io) {
+    auto& builder = state.builder;
+    // Every function gets a copy taking the context first, which its body moves to.
+    std::map<llvm::Function*, llvm::Function*> withContext;
+    for (auto* function : functions) {
+        std::vector<llvm::Type*> params = {state.getPtrTy()};
+        llvm::append_range(params, function->getFunctionType()->params());
+        auto* copy = llvm::Function::Create(llvm::FunctionType::get(function->getReturnType(), params, false),
+                                            function->getLinkage(), "", state.module);
+        copy->takeName(function);
+        copy->getArg(0)->setName("context");
+        copy->setSubprogram(function->getSubprogram());
+        if (auto entryCount = function->getEntryCount())
+            copy->setEntryCount(*entryCount);
+        copy->splice(copy->begin(), function);
+        for (auto& argument : function->args()) {
+            auto* copyArgument = copy->getArg(argument.getArgNo() + 1);
+            copyArgument->takeName(&argument);
+            argument.replaceAllUsesWith(copyArgument);
+        }
+        withContext[function] = copy;
+    }
+
+    // A call passes on the context of the function it is in.
+    auto replaceCalls = [&](llvm::Function* callee, llvm::Function* replacement) {
+        for (auto* user : llvm::make_early_inc_range(callee->users())) {
+            auto* call = llvm::dyn_cast<llvm::CallInst>(user);
+            if (call == nullptr)
+                continue;
+            std::vector<llvm::Value*> arguments = {call->getFunction()->getArg(0)};
+            llvm::append_range(arguments, call->args());
+            builder.SetInsertPoint(call);
+            auto* replacementCall = builder.CreateCall(replacement, arguments);
+            // The results of putchar and printf are not used, the replacements have none.
+            if (!call->use_empty()) {
+                replacementCall->takeName(call);
+                call->replaceAllUsesWith(replacementCall);
+            }
+            call->eraseFromParent();
+        }
+    };
+    for (const auto& [function, copy] : withContext) {
+        replaceCalls(function, copy);
+    }
+    for (const auto& [name, replacement] : io) {
+        if (auto* function = state.module.getFunction(name))
+            replaceCalls(function, replacement);
+    }
+    // The replacements took the debug locations of the calls, which belong to the program.
+    builder.SetCurrentDebugLocation(llvm::DebugLoc());
+
+    for (const auto& [function, copy] : withContext) {
+        function->eraseFromParent();
+    }
+    // readChar calls getchar, so it goes first.
+    for (const auto& name : {"readChar", "getchar", "putchar", "printf"}) {
+        auto* function = state.module.getFunction(name);
+        if (function != nullptr && function->use_empty())
+            function->eraseFromParent();
+    }
+}
+
+void LibraryGenerator::generateEntryPoint(llvm::Function* program, const std::string& symbol) {
+    auto& builder = state.builder;
+    auto* ptrTy = state.getPtrTy();
+    auto* entryPoint = llvm::Function::Create(
+            llvm::FunctionType::get(builder.getInt32Ty(), {ptrTy, sizeTy, ptrTy, sizeTy, ptrTy}, false),
+            llvm::GlobalValue::ExternalLinkage, symbol, state.module);
+    auto* input = entryPoint->getArg(0);
+    auto* outputCapacity = entryPoint->getArg(3);
+    input->setName("in");
+    entryPoint->getArg(1)->setName("inLen");
+    entryPoint->getArg(2)->setName("out");
+    outputCapacity->setName("outCap");
+    entryPoint->getArg(4)->setName("outLen");
+
+    builder.SetInsertPoint(state.createBasicBlock("run program", entryPoint));
+    auto* context = builder.CreateAlloca(contextTy, nullptr, "context");
+    builder.CreateStore(input, getField(context, kInput));
+    builder.CreateStore(builder.CreateInBoundsGEP(builder.getInt8Ty(), input, entryPoint->getArg(1)),
+                        getField(context, kInputEnd));
+    builder.CreateStore(entryPoint->getArg(2), getField(context, kOutput));
+    builder.CreateStore(outputCapacity, getField(context, kOutputCapacity));
+    builder.CreateStore(llvm::ConstantInt::get(sizeTy, 0), getField(context, kOutputLength));
+    builder.CreateCall(program, {context});
+
+    auto* outputLength = loadField(context, kOutputLength);
+    builder.CreateStore(outputLength, entryPoint->getArg(4));
+    builder.CreateRet(builder.CreateZExt(builder.CreateICmpUGT(outputLength, outputCapacity), builder.getInt32Ty()));
+}
+
+void LibraryGenerator::generate(const std::string& symbol) {
+    auto* writeChar = generateWriteChar();
+    std::map<std::string, llvm::Function*> io = {
+        {"readChar", generateReadChar()},
+        {"putchar", writeChar},
+        {"printf", generatePrintInt(writeChar)},
+    };
+    passContext(findFunctionsDoingIO(), io);
+
+    auto* program = state.module.getFunction("main");
+    program->setName("yabfpp.lib.program");
+    // Only the entry point is exported, so that the BF++ functions and the helpers of two libraries, or of a
+    // library and its host, neither clash nor merge. A function named like the entry point makes way for it.
+    for (auto& function : state.module) {
+        if (function.isDeclaration())
+            continue;
+        function.setLinkage(llvm::GlobalValue::InternalLinkage);
+        if (function.getName() == symbol)
+            function.setName("yabfpp.lib." + symbol);
+    }
+    generateEntryPoint(program, symbol);
+}
+
+}
+
+void generateLibrary(CompilerState& state, const std::string& symbol) {
+    LibraryGenerator(state).generate(symbol);
+}
+
+std::string getLibraryHeader(const std::string& symbol, const std::string& sourcePath) {
+    auto guard = std::format("YABFPP_{}_H", symbol);
+    for (auto& c : guard) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    return std::format(R"(// Generated by yabfpp from {1}.
+#ifndef {2}
+#define {2}
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {{
+#endif
+
+// Runs the program on the inLen bytes at in, writing its output to out. *outLen is set to the length of the whole
+// output. Returns 1 if that exceeds outCap, in which case only the first outCap bytes are written, and 0 otherwise.
+// May be called from several threads at once.
+int {0}(const uint8_t* in, size_t inLen, uint8_t* out, size_t outCap, size_t* outLen);
+
+#ifdef __cplusplus
+}}
+#endif
+
+#endif
+)", symbol, std::filesystem::path(sourcePath).filename().string(), guard);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+class CompilerState;
+
+// Turns the program into a function a C or C++ host calls instead of running an executable:
+//
+//     int symbol(const uint8_t* in, size_t inLen, uint8_t* out, size_t outCap, size_t* outLen);
+//
+// The program reads the inLen bytes at in as its input and writes its output to out. *outLen is set to the length
+// of the whole output. Returns 1 if that exceeds outCap, in which case only the first outCap bytes are written, and
+// 0 otherwise.
+//
+// The cursors into the buffers are kept in a context on the stack of the call, which main and every function doing
+// I/O get as an extra first argument, so the module has no mutable globals and the function may be called from
+// several threads at once. Call after CompilerState::finalize, with the tape of the main program freed.
+void generateLibrary(CompilerState& state, const std::string& symbol);
+
+// The C header declaring the function generateLibrary exports.
+std::string getLibraryHeader(const std::string& symbol, const std::string& sourcePath);
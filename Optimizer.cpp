@@ -0,0 +1,15 @@
+#include "Optimizer.h"
+#include "AffineLoopLowering.h"
+#include "BoundsCheckHoisting.h"
+#include "ConstantPropagation.h"
+#include "DeadCodeElimination.h"
+
+Expr optimize(const Expr& expr, CompileStats* stats) {
+    // The dead code is eliminated again for the variables whose reads the propagation replaced.
+    auto propagated = eliminateDeadCode(propagateConstants(eliminateDeadCode(expr, stats)), stats);
+    return hoistBoundsChecks(lowerAffineLoops(propagated));
+}
+
+Expr optimizeConstruct(const Expr& construct) {
+    return hoistBoundsChecks(lowerAffineLoops(construct));
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "CompileStats.h"
+#include "Expr.h"
+
+// Runs the AST-level passes over the parsed program, counting what they remove into the stats, if any.
+Expr optimize(const Expr& expr, CompileStats* stats = nullptr);
+
+// Runs the passes which need nothing beyond a single top-level construct, for a program generated while it is
+// parsed. The dead-code elimination and the constant propagation follow the whole program, so they are left out.
+Expr optimizeConstruct(const Expr& construct);
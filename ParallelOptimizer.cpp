@@ -0,0 +1,81 @@
+#include "ParallelOptimizer.h"
+#include "PassPipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+namespace {
+
+using Bitcode = llvm::SmallVector<char, 0>;
+
+// A context may only be used by one thread at a time, so the partitions travel between the threads as bitcode.
+Bitcode writeBitcode(const llvm::Module& module) {
+    Bitcode bitcode;
+    llvm::raw_svector_ostream out(bitcode);
+    llvm::WriteBitcodeToFile(module, out);
+    return bitcode;
+}
+
+std::unique_ptr<llvm::Module> readBitcode(const Bitcode& bitcode, llvm::LLVMContext& context) {
+    llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode.data(), bitcode.size()), "partition");
+    return llvm::cantFail(llvm::parseBitcodeFile(buffer, context));
+}
+
+unsigned countDefinedFunctions(const llvm::Module& module) {
+    return std::ranges::count_if(module, [](const llvm::Function& function) { return !function.isDeclaration(); });
+}
+
+void optimizePartition(Bitcode& partition, int optLevel) {
+    llvm::LLVMContext context;
+    auto module = readBitcode(partition, context);
+    runOptimizationPipeline(*module, optLevel);
+    partition = writeBitcode(*module);
+}
+
+}
+
+bool optimizeInPartitions(llvm::Module& module, int optLevel, int jobs, const std::string& outputPath) {
+    std::vector<Bitcode> partitions;
+    llvm::SplitModule(module, std::max(countDefinedFunctions(module), 1u), [&](std::unique_ptr<llvm::Module> part) {
+        partitions.push_back(writeBitcode(*part));
+    });
+
+    if (jobs <= 0)
+        jobs = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    std::atomic<size_t> nextPartition = 0;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < std::min<int>(jobs, partitions.size()); i++) {
+        workers.emplace_back([&] {
+            for (size_t index = nextPartition++; index < partitions.size(); index = nextPartition++) {
+                optimizePartition(partitions[index], optLevel);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    llvm::LLVMContext context;
+    auto linked = readBitcode(partitions.front(), context);
+    for (size_t index = 1; index < partitions.size(); index++) {
+        if (llvm::Linker::linkModules(*linked, readBitcode(partitions[index], context)))
+            return false;
+    }
+    linked->setModuleIdentifier(module.getModuleIdentifier());
+    linked->setSourceFileName(module.getSourceFileName());
+
+    std::error_code error;
+    llvm::raw_fd_ostream out(outputPath, error);
+    if (error)
+        return false;
+    linked->print(out, nullptr);
+    return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+#include "llvm/IR/Module.h"
+
+// Splits the module into partitions by function, optimises every partition in a context of its own on up to
+// jobs threads and links the partitions back in their order into the output. The number of partitions depends
+// on the module only, so the output is the same for any number of threads. Returns false if the partitions
+// could not be linked or the output could not be written.
+bool optimizeInPartitions(llvm::Module& module, int optLevel, int jobs, const std::string& outputPath);
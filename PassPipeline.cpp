@@ -0,0 +1,35 @@
+#include "PassPipeline.h"
+
+#include <llvm/Passes/PassBuilder.h>
+
+static llvm::OptimizationLevel toOptimizationLevel(int optLevel) {
+    switch (optLevel) {
+        case 1:
+            return llvm::OptimizationLevel::O1;
+        case 2:
+            return llvm::OptimizationLevel::O2;
+        default:
+            return llvm::OptimizationLevel::O3;
+    }
+}
+
+void runOptimizationPipeline(llvm::Module& module, int optLevel) {
+    if (optLevel <= 0)
+        return;
+
+    llvm::LoopAnalysisManager loopAnalysisManager;
+    llvm::FunctionAnalysisManager functionAnalysisManager;
+    llvm::CGSCCAnalysisManager cgsccAnalysisManager;
+    llvm::ModuleAnalysisManager moduleAnalysisManager;
+
+    llvm::PassBuilder passBuilder;
+    passBuilder.registerModuleAnalyses(moduleAnalysisManager);
+    passBuilder.registerCGSCCAnalyses(cgsccAnalysisManager);
+    passBuilder.registerFunctionAnalyses(functionAnalysisManager);
+    passBuilder.registerLoopAnalyses(loopAnalysisManager);
+    passBuilder.crossRegisterProxies(loopAnalysisManager, functionAnalysisManager,
+                                     cgsccAnalysisManager, moduleAnalysisManager);
+
+    auto modulePassManager = passBuilder.buildPerModuleDefaultPipeline(toOptimizationLevel(optLevel));
+    modulePassManager.run(module, moduleAnalysisManager);
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <llvm/IR/Module.h>
+
+// Runs the default LLVM pipeline of the given level (0 to 3) over the module. Level 0 leaves the module as is.
+void runOptimizationPipeline(llvm::Module& module, int optLevel);
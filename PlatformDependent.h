@@ -8,21 +8,26 @@
 #include <climits>
 #include <string_view>
 #include <iostream>
+#include <unistd.h>
 
 struct PlatformDependent {
     int eOF;
     bool isCharSigned;
+    // The sysconf name of the number of the online cores.
+    int scNProcessorsOnln;
 };
 
 inline PlatformDependent getPlatformDependent(std::string_view target) {
     static constexpr PlatformDependent kX86_64PCLinuxGNU {
         .eOF = -1,
-        .isCharSigned = true
+        .isCharSigned = true,
+        .scNProcessorsOnln = 84
     };
 
     static constexpr PlatformDependent kDefaultPlatform {
         .eOF = EOF,
-        .isCharSigned = CHAR_MIN < 0
+        .isCharSigned = CHAR_MIN < 0,
+        .scNProcessorsOnln = _SC_NPROCESSORS_ONLN
     };
 
     if (target == "x86_64-pc-linux-gnu" || target == "wasm32-unknown-emscripten")
@@ -0,0 +1,95 @@
+#include "Profile.h"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <map>
+#include <print>
+#include <sstream>
+
+namespace {
+
+constexpr size_t kSnippetLength = 60;
+
+std::string getEventKey(std::string_view kind, SourceLocation location) {
+    return std::format("{} {} {}", kind, location.line, location.column);
+}
+
+std::string getSnippet(const std::vector<std::string>& sourceLines, SourceLocation location) {
+    if (location.line < 1 || location.line > static_cast<int>(sourceLines.size()))
+        return "";
+    const auto& line = sourceLines[location.line - 1];
+    auto begin = line.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return "";
+    auto end = line.find_last_not_of(" \t") + 1;
+    auto snippet = line.substr(begin, std::min(end - begin, kSnippetLength));
+    return end - begin > kSnippetLength ? snippet + "..." : snippet;
+}
+
+void printEntries(std::vector<ProfileEntry> entries, const std::vector<std::string>& sourceLines, int top) {
+    std::ranges::stable_sort(entries, std::ranges::greater{}, &ProfileEntry::count);
+    entries.resize(std::min<size_t>(entries.size(), std::max(top, 0)));
+    for (const auto& entry : entries) {
+        std::println("{:>20}  {:>5}:{:<4} {:<12} {}", entry.count, entry.location.line, entry.location.column,
+                     entry.name, getSnippet(sourceLines, entry.location));
+    }
+}
+
+}
+
+ProfileData::ProfileData(const std::vector<ProfileEntry>& profile) {
+    for (const auto& entry : profile) {
+        counts[getEventKey(entry.kind, entry.location)] += entry.count;
+    }
+}
+
+std::optional<uint64_t> ProfileData::getCount(std::string_view kind, SourceLocation location) const {
+    auto it = counts.find(getEventKey(kind, location));
+    if (it == counts.end())
+        return std::nullopt;
+    return it->second;
+}
+
+std::optional<std::vector<ProfileEntry>> readProfile(const std::string& path) {
+    std::ifstream input(path);
+    if (!input.good())
+        return std::nullopt;
+    std::vector<ProfileEntry> profile;
+    for (std::string line; std::getline(input, line);) {
+        std::istringstream fields(line);
+        ProfileEntry entry;
+        if (!(fields >> entry.kind >> entry.location.line >> entry.location.column >> entry.name >> entry.count))
+            return std::nullopt;
+        profile.push_back(std::move(entry));
+    }
+    return profile;
+}
+
+void printProfileReport(const std::vector<ProfileEntry>& profile, const std::vector<std::string>& sourceLines,
+                        int top) {
+    std::vector<ProfileEntry> loops;
+    // A function declared more than once is reported once, at its first declaration.
+    std::map<std::string, ProfileEntry> functions;
+    for (const auto& entry : profile) {
+        if (entry.kind == "loop") {
+            loops.push_back(entry);
+        } else if (entry.kind == "function") {
+            auto [it, isNew] = functions.try_emplace(entry.name, entry);
+            if (!isNew)
+                it->second.count += entry.count;
+        }
+    }
+
+    std::println("Hottest loops, by iterations");
+    std::println("{:>20}  {:>5}:{:<4} {:<12} {}", "iterations", "line", "col", "", "source");
+    printEntries(std::move(loops), sourceLines, top);
+
+    std::println("Hottest functions, by calls");
+    std::println("{:>20}  {:>5}:{:<4} {:<12} {}", "calls", "line", "col", "function", "source");
+    std::vector<ProfileEntry> functionEntries;
+    for (auto& [name, entry] : functions) {
+        functionEntries.push_back(std::move(entry));
+    }
+    printEntries(std::move(functionEntries), sourceLines, top);
+}
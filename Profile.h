@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Source.h"
+
+// A line of the profile an instrumented program writes.
+struct ProfileEntry {
+    std::string kind;
+    SourceLocation location;
+    std::string name;
+    uint64_t count;
+};
+
+// The counts of a profile by the kind of the event and the location of the construct it happened at.
+class ProfileData {
+private:
+    std::unordered_map<std::string, uint64_t> counts;
+public:
+    explicit ProfileData(const std::vector<ProfileEntry>& profile);
+
+    [[nodiscard]] std::optional<uint64_t> getCount(std::string_view kind, SourceLocation location) const;
+};
+
+// Returns std::nullopt if the file cannot be read or is not a profile.
+std::optional<std::vector<ProfileEntry>> readProfile(const std::string& path);
+
+// Ranks the loops by their iterations and the functions by their calls, showing the source line of each.
+void printProfileReport(const std::vector<ProfileEntry>& profile, const std::vector<std::string>& sourceLines,
+                        int top);
@@ -0,0 +1,328 @@
+#include "RecordRunner.h"
+#include "CompilerState.h"
+
+#include <functional>
+#include <llvm/ADT/STLExtras.h>
+
+namespace {
+
+// The records read before the threads start on them. Bounds the memory, so that the stream may be of any length.
+constexpr int64_t kChunkSize = 1 << 16;
+
+struct RecordGlobals {
+    // Shared by the threads: the records of the chunk, their outputs, how many there are and the next one to take.
+    llvm::GlobalVariable* data;
+    llvm::GlobalVariable* length;
+    llvm::GlobalVariable* output;
+    llvm::GlobalVariable* outputLength;
+    llvm::GlobalVariable* count;
+    llvm::GlobalVariable* next;
+    // Thread-local: the rest of the record the thread processes and the stream its output goes to.
+    llvm::GlobalVariable* input;
+    llvm::GlobalVariable* inputEnd;
+    llvm::GlobalVariable* outputFile;
+};
+
+llvm::GlobalVariable* createGlobal(CompilerState& state, llvm::Type* type, const std::string& name,
+                                   bool isThreadLocal) {
+    return new llvm::GlobalVariable(state.module, type, false, llvm::GlobalValue::InternalLinkage,
+                                    llvm::Constant::getNullValue(type), name, nullptr,
+                                    isThreadLocal ? llvm::GlobalValue::GeneralDynamicTLSModel
+                                                  : llvm::GlobalValue::NotThreadLocal);
+}
+
+RecordGlobals createGlobals(CompilerState& state) {
+    auto* ptrTy = state.getPtrTy();
+    auto* int64Ty = state.builder.getInt64Ty();
+    return {
+        .data = createGlobal(state, ptrTy, "yabfpp.records.data", false),
+        .length = createGlobal(state, ptrTy, "yabfpp.records.length", false),
+        .output = createGlobal(state, ptrTy, "yabfpp.records.output", false),
+        .outputLength = createGlobal(state, ptrTy, "yabfpp.records.outputLength", false),
+        .count = createGlobal(state, int64Ty, "yabfpp.records.count", false),
+        .next = createGlobal(state, int64Ty, "yabfpp.records.next", false),
+        .input = createGlobal(state, ptrTy, "yabfpp.record.input", true),
+        .inputEnd = createGlobal(state, ptrTy, "yabfpp.record.inputEnd", true),
+        .outputFile = createGlobal(state, ptrTy, "yabfpp.record.outputFile", true),
+    };
+}
+
+// Generates body for every index from 0 to count - 1. The count must be at least 1.
+void generateLoop(CompilerState& state, llvm::Value* count, const std::string& name,
+                  const std::function<void(llvm::Value*)>& body) {
+    auto& builder = state.builder;
+    auto* function = builder.GetInsertBlock()->getParent();
+    auto* preheaderBB = builder.GetInsertBlock();
+    auto* loopBB = state.createBasicBlock(name, function);
+    auto* afterLoopBB = state.createBasicBlock("after " + name, function);
+    builder.CreateBr(loopBB);
+
+    builder.SetInsertPoint(loopBB);
+    auto* index = builder.CreatePHI(count->getType(), 2, name + " index");
+    index->addIncoming(llvm::ConstantInt::get(count->getType(), 0), preheaderBB);
+    body(index);
+    auto* next = builder.CreateAdd(index, llvm::ConstantInt::get(count->getType(), 1), name + " next index");
+    index->addIncoming(next, builder.GetInsertBlock());
+    builder.CreateCondBr(builder.CreateICmpULT(next, count), loopBB, afterLoopBB);
+
+    builder.SetInsertPoint(afterLoopBB);
+}
+
+// Replaces every call to the function with what generate creates in its place.
+void replaceCalls(CompilerState& state, llvm::StringRef name,
+                  const std::function<llvm::Value*(llvm::CallInst*)>& generate) {
+    auto* function = state.module.getFunction(name);
+    if (function == nullptr)
+        return;
+    for (auto* user : llvm::make_early_inc_range(function->users())) {
+        auto* call = llvm::dyn_cast<llvm::CallInst>(user);
+        if (call == nullptr)
+            continue;
+        state.builder.SetInsertPoint(call);
+        call->replaceAllUsesWith(generate(call));
+        call->eraseFromParent();
+    }
+}
+
+llvm::Function* generateReadChar(CompilerState& state, const RecordGlobals& globals) {
+    auto& builder = state.builder;
+    auto* ptrTy = state.getPtrTy();
+    auto* readChar = llvm::Function::Create(llvm::FunctionType::get(builder.getInt8Ty(), false),
+                                            llvm::GlobalValue::InternalLinkage, "yabfpp.record.readChar",
+                                            state.module);
+    auto* entryBB = state.createBasicBlock("read record char", readChar);
+    auto* endBB = state.createBasicBlock("end of record", readChar);
+    auto* charBB = state.createBasicBlock("record char", readChar);
+
+    builder.SetInsertPoint(entryBB);
+    auto* inputPtr = builder.CreateThreadLocalAddress(globals.input);
+    auto* input = builder.CreateLoad(Pointer{ptrTy, inputPtr});
+    auto* inputEnd = builder.CreateLoad(Pointer{ptrTy, builder.CreateThreadLocalAddress(globals.inputEnd)});
+    builder.CreateCondBr(builder.CreateICmpEQ(input, inputEnd, "is end of record"), endBB, charBB);
+
+    builder.SetInsertPoint(endBB);
+    // What readChar returns on EOF.
+    builder.CreateRet(state.getConstChar(0));
+
+    builder.SetInsertPoint(charBB);
+    auto* theChar = builder.CreateLoad(Pointer{builder.getInt8Ty(), input});
+    builder.CreateStore(builder.CreateConstInBoundsGEP1_64(builder.getInt8Ty(), input, 1), inputPtr);
+    builder.CreateRet(theChar);
+    return readChar;
+}
+
+void retargetIO(CompilerState& state, const RecordGlobals& globals) {
+    auto& module = state.module;
+    auto& builder = state.builder;
+    auto* ptrTy = state.getPtrTy();
+    auto* int32Ty = builder.getInt32Ty();
+    auto fputc = module.getOrInsertFunction("fputc", int32Ty, int32Ty, ptrTy);
+    auto fprintf = module.getOrInsertFunction("fprintf", llvm::FunctionType::get(int32Ty, {ptrTy, ptrTy}, true));
+    auto* readChar = generateReadChar(state, globals);
+
+    auto outputFile = [&] {
+        return builder.CreateLoad(Pointer{ptrTy, builder.CreateThreadLocalAddress(globals.outputFile)});
+    };
+    replaceCalls(state, "readChar", [&](llvm::CallInst*) {
+        return builder.CreateCall(readChar, {});
+    });
+    replaceCalls(state, "putchar", [&](llvm::CallInst* call) {
+        return builder.CreateCall(fputc, {builder.CreateZExt(call->getArgOperand(0), int32Ty), outputFile()});
+    });
+    replaceCalls(state, "printf", [&](llvm::CallInst* call) {
+        return builder.CreateCall(fprintf, {outputFile(), call->getArgOperand(0), call->getArgOperand(1)});
+    });
+    // The replacements took the debug locations of the calls, which belong to the program.
+    builder.SetCurrentDebugLocation(llvm::DebugLoc());
+}
+
+llvm::Function* generateWorker(CompilerState& state, const RecordGlobals& globals, llvm::Function* processRecord) {
+    auto& module = state.module;
+    auto& builder = state.builder;
+    auto* ptrTy = state.getPtrTy();
+    auto* int64Ty = builder.getInt64Ty();
+    auto* sizeTy = state.clib.getSizeTy();
+    auto openMemstream = module.getOrInsertFunction("open_memstream", ptrTy, ptrTy, ptrTy);
+    auto fclose = module.getOrInsertFunction("fclose", builder.getInt32Ty(), ptrTy);
+
+    auto* worker = llvm::Function::Create(llvm::FunctionType::get(ptrTy, {ptrTy}, false),
+                                          llvm::GlobalValue::InternalLinkage, "yabfpp.record.worker", module);
+    auto* takeBB = state.createBasicBlock("take record", worker);
+    auto* processBB = state.createBasicBlock("process record", worker);
+    auto* exitBB = state.createBasicBlock("no records left", worker);
+
+    builder.SetInsertPoint(takeBB);
+    auto* index = builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, globals.next, builder.getInt64(1),
+                                          llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
+    auto* count = builder.CreateLoad(Pointer{int64Ty, globals.count});
+    builder.CreateCondBr(builder.CreateICmpSGE(index, count, "is every record taken"), exitBB, processBB);
+
+    builder.SetInsertPoint(processBB);
+    auto element = [&](llvm::GlobalVariable* array, llvm::Type* type) {
+        return builder.CreateInBoundsGEP(type, builder.CreateLoad(Pointer{ptrTy, array}), index);
+    };
+    auto* data = builder.CreateLoad(Pointer{ptrTy, element(globals.data, ptrTy)});
+    auto* length = builder.CreateLoad(Pointer{sizeTy, element(globals.length, sizeTy)});
+    builder.CreateStore(data, builder.CreateThreadLocalAddress(globals.input));
+    builder.CreateStore(builder.CreateInBoundsGEP(builder.getInt8Ty(), data, length),
+                        builder.CreateThreadLocalAddress(globals.inputEnd));
+    // The stream grows the buffer, which is where the output is left once it is closed.
+    auto* file = builder.CreateCall(openMemstream, {element(globals.output, ptrTy),
+                                                    element(globals.outputLength, sizeTy)});
+    builder.CreateStore(file, builder.CreateThreadLocalAddress(globals.outputFile));
+    builder.CreateCall(processRecord, {});
+    builder.CreateCall(fclose, {file});
+    builder.CreateBr(takeBB);
+
+    builder.SetInsertPoint(exitBB);
+    builder.CreateRet(llvm::ConstantPointerNull::get(ptrTy));
+    return worker;
+}
+
+void generateMain(CompilerState& state, const RecordGlobals& globals, llvm::Function* worker) {
+    auto& module = state.module;
+    auto& builder = state.builder;
+    auto* ptrTy = state.getPtrTy();
+    auto* int32Ty = builder.getInt32Ty();
+    auto* int64Ty = builder.getInt64Ty();
+    // On the targets with pthreads and open_memstream, long and pthread_t are as wide as size_t and a pointer.
+    auto* sizeTy = state.clib.getSizeTy();
+    auto* longTy = sizeTy;
+    auto* pthreadTy = sizeTy;
+    int slotBytes = static_cast<int>(sizeTy->getBitWidth() / 8);
+    auto size = [&](uint64_t value) { return llvm::ConstantInt::get(sizeTy, value); };
+    auto atoi = module.getOrInsertFunction("atoi", int32Ty, ptrTy);
+    auto sysconf = module.getOrInsertFunction("sysconf", longTy, int32Ty);
+    auto malloc = module.getOrInsertFunction("malloc", ptrTy, sizeTy);
+    auto free = module.getOrInsertFunction("free", builder.getVoidTy(), ptrTy);
+    auto fdopen = module.getOrInsertFunction("fdopen", ptrTy, int32Ty, ptrTy);
+    auto fread = module.getOrInsertFunction("fread", sizeTy, ptrTy, sizeTy, sizeTy, ptrTy);
+    auto fwrite = module.getOrInsertFunction("fwrite", sizeTy, ptrTy, sizeTy, sizeTy, ptrTy);
+    auto fclose = module.getOrInsertFunction("fclose", int32Ty, ptrTy);
+    // pthread_t is passed by value.
+    auto pthreadCreate = module.getOrInsertFunction("pthread_create", int32Ty, ptrTy, ptrTy, ptrTy, ptrTy);
+    auto pthreadJoin = module.getOrInsertFunction("pthread_join", int32Ty, pthreadTy, ptrTy);
+
+    auto* main = llvm::Function::Create(llvm::FunctionType::get(int32Ty, {int32Ty, ptrTy}, false),
+                                        llvm::GlobalValue::ExternalLinkage, "main", module);
+    auto* argc = main->getArg(0);
+    auto* argv = main->getArg(1);
+    auto* entryBB = state.createBasicBlock("records", main);
+    auto* threadsArgumentBB = state.createBasicBlock("threads from the argument", main);
+    auto* threadsCoresBB = state.createBasicBlock("threads from the cores", main);
+    auto* startBB = state.createBasicBlock("start", main);
+    auto* chunkBB = state.createBasicBlock("read chunk", main);
+    auto* readLoopBB = state.createBasicBlock("read records", main);
+    auto* readLengthBB = state.createBasicBlock("read record length", main);
+    auto* readDataBB = state.createBasicBlock("read record data", main);
+    auto* runBB = state.createBasicBlock("run chunk", main);
+    auto* processBB = state.createBasicBlock("process chunk", main);
+    auto* exitBB = state.createBasicBlock("every record processed", main);
+
+    builder.SetInsertPoint(entryBB);
+    auto* lengthSlot = builder.CreateAlloca(int32Ty, nullptr, "record length");
+    builder.CreateCondBr(builder.CreateICmpSGT(argc, builder.getInt32(1)), threadsArgumentBB, threadsCoresBB);
+
+    builder.SetInsertPoint(threadsArgumentBB);
+    auto* argument = builder.CreateLoad(Pointer{ptrTy, builder.CreateConstInBoundsGEP1_64(ptrTy, argv, 1)});
+    auto* argumentThreads = builder.CreateCall(atoi, {argument});
+    builder.CreateBr(startBB);
+
+    builder.SetInsertPoint(threadsCoresBB);
+    auto* cores = builder.CreateCall(sysconf, {builder.getInt32(state.getPlatform().scNProcessorsOnln)});
+    auto* coreThreads = builder.CreateTrunc(cores, int32Ty);
+    builder.CreateBr(startBB);
+
+    builder.SetInsertPoint(startBB);
+    auto* requestedThreads = builder.CreatePHI(int32Ty, 2, "requested threads");
+    requestedThreads->addIncoming(argumentThreads, threadsArgumentBB);
+    requestedThreads->addIncoming(coreThreads, threadsCoresBB);
+    auto* threads = builder.CreateZExt(
+            builder.CreateSelect(builder.CreateICmpSLT(requestedThreads, builder.getInt32(1)), builder.getInt32(1),
+                                 requestedThreads), sizeTy, "threads");
+    auto* threadIds = builder.CreateCall(malloc, {builder.CreateMul(threads, size(slotBytes))});
+    // Pointers and sizes.
+    for (auto* array : {globals.data, globals.length, globals.output, globals.outputLength}) {
+        builder.CreateStore(builder.CreateCall(malloc, {size(kChunkSize * slotBytes)}), array);
+    }
+    auto* in = builder.CreateCall(fdopen, {builder.getInt32(0), builder.CreateGlobalString("r", "", 0, &module)});
+    auto* out = builder.CreateCall(fdopen, {builder.getInt32(1), builder.CreateGlobalString("w", "", 0, &module)});
+    builder.CreateBr(chunkBB);
+
+    builder.SetInsertPoint(chunkBB);
+    builder.CreateStore(builder.getInt64(0), globals.count);
+    builder.CreateBr(readLoopBB);
+
+    builder.SetInsertPoint(readLoopBB);
+    auto* count = builder.CreateLoad(Pointer{int64Ty, globals.count});
+    builder.CreateCondBr(builder.CreateICmpEQ(count, builder.getInt64(kChunkSize), "is chunk full"), runBB,
+                         readLengthBB);
+
+    builder.SetInsertPoint(readLengthBB);
+    auto* lengthsRead = builder.CreateCall(fread, {lengthSlot, size(4), size(1), in});
+    builder.CreateCondBr(builder.CreateICmpEQ(lengthsRead, size(1), "is there a record"), readDataBB,
+                         runBB);
+
+    builder.SetInsertPoint(readDataBB);
+    auto* length = builder.CreateZExt(builder.CreateLoad(Pointer{int32Ty, lengthSlot}), sizeTy);
+    auto* data = builder.CreateCall(malloc, {builder.CreateAdd(length, size(1))});
+    // A record cut short by the end of the stream is what is left of it.
+    auto* dataRead = builder.CreateCall(fread, {data, size(1), length, in});
+    auto element = [&](llvm::GlobalVariable* array, llvm::Type* type, llvm::Value* index) {
+        return builder.CreateInBoundsGEP(type, builder.CreateLoad(Pointer{ptrTy, array}), index);
+    };
+    builder.CreateStore(data, element(globals.data, ptrTy, count));
+    builder.CreateStore(dataRead, element(globals.length, sizeTy, count));
+    builder.CreateStore(builder.CreateAdd(count, builder.getInt64(1)), globals.count);
+    builder.CreateBr(readLoopBB);
+
+    builder.SetInsertPoint(runBB);
+    auto* chunkSize = builder.CreateLoad(Pointer{int64Ty, globals.count});
+    builder.CreateCondBr(builder.CreateICmpEQ(chunkSize, builder.getInt64(0), "is chunk empty"), exitBB, processBB);
+
+    builder.SetInsertPoint(processBB);
+    builder.CreateStore(builder.getInt64(0), globals.next);
+    generateLoop(state, threads, "start thread", [&](llvm::Value* thread) {
+        builder.CreateCall(pthreadCreate, {builder.CreateInBoundsGEP(pthreadTy, threadIds, thread),
+                                           llvm::ConstantPointerNull::get(ptrTy), worker,
+                                           llvm::ConstantPointerNull::get(ptrTy)});
+    });
+    generateLoop(state, threads, "join thread", [&](llvm::Value* thread) {
+        auto* threadId = builder.CreateLoad(Pointer{pthreadTy, builder.CreateInBoundsGEP(pthreadTy, threadIds,
+                                                                                         thread)});
+        builder.CreateCall(pthreadJoin, {threadId, llvm::ConstantPointerNull::get(ptrTy)});
+    });
+    generateLoop(state, chunkSize, "write output", [&](llvm::Value* record) {
+        auto* output = builder.CreateLoad(Pointer{ptrTy, element(globals.output, ptrTy, record)});
+        auto* outputLength = builder.CreateLoad(Pointer{sizeTy, element(globals.outputLength, sizeTy, record)});
+        builder.CreateStore(builder.CreateTrunc(outputLength, int32Ty), lengthSlot);
+        builder.CreateCall(fwrite, {lengthSlot, size(4), size(1), out});
+        builder.CreateCall(fwrite, {output, size(1), outputLength, out});
+        builder.CreateCall(free, {output});
+        builder.CreateCall(free, {builder.CreateLoad(Pointer{ptrTy, element(globals.data, ptrTy, record)})});
+    });
+    // A chunk which is not full is the last one.
+    builder.CreateCondBr(builder.CreateICmpEQ(chunkSize, builder.getInt64(kChunkSize), "was chunk full"), chunkBB,
+                         exitBB);
+
+    // The threads and the arrays serve every chunk, so they go once all the chunks have run.
+    builder.SetInsertPoint(exitBB);
+    builder.CreateCall(free, {threadIds});
+    for (auto* array : {globals.data, globals.length, globals.output, globals.outputLength}) {
+        builder.CreateCall(free, {builder.CreateLoad(Pointer{ptrTy, array})});
+    }
+    builder.CreateCall(fclose, {out});
+    builder.CreateRet(builder.getInt32(0));
+}
+
+}
+
+void generateRecordRunner(CompilerState& state) {
+    auto* processRecord = state.module.getFunction("main");
+    processRecord->setName("yabfpp.processRecord");
+    processRecord->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+    auto globals = createGlobals(state);
+    retargetIO(state, globals);
+    generateMain(state, globals, generateWorker(state, globals, processRecord));
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+class CompilerState;
+
+// Turns the program into one which runs once per input record, on as many threads as the first command line
+// argument says or as there are cores. A record is its length as a 32-bit integer in the byte order of the target,
+// followed by its bytes. The program reads the record as its input, and its output is written back in the same
+// framing, in the order of the records. Every run has a tape and variables of its own.
+//
+// The main program becomes yabfpp.processRecord, its getchar, putchar and printf go to the record, and a new main
+// reads the records in chunks, processes every chunk on the threads and writes the outputs. Call after
+// CompilerState::finalize, with the tape of the main program freed.
+void generateRecordRunner(CompilerState& state);
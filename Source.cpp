@@ -4,6 +4,7 @@
 
 #include "Source.h"
 
+#include <fstream>
 #include <set>
 #include <utility>
 #include <algorithm>
@@ -98,3 +99,15 @@ Source::Iterator Source::begin() const {
 Source::Iterator Source::end() const {
     return {this, this->lines.end(), std::string("").begin()};
 }
+
+std::optional<std::vector<std::string>> readFile(const std::string& inputPath) {
+    const char COMMENT_SEPARATOR = ';';
+    std::ifstream input(inputPath);
+    if (!input.good())
+        return std::nullopt;
+    std::vector<std::string> program;
+    for (std::string line; getline(input, line);) {
+        program.push_back(line.substr(0, line.find(COMMENT_SEPARATOR, 0)));
+    }
+    return program;
+}
@@ -8,8 +8,15 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <optional>
 
 
+// Both are 1-based. A node the parser did not produce has neither.
+struct SourceLocation {
+    int line = 0;
+    int column = 0;
+};
+
 class Source {
 private:
     const std::vector<std::string> lines;
@@ -48,6 +55,8 @@ public:
 
         int getLinePosition() const;
 
+        [[nodiscard]] SourceLocation getLocation() const { return {getLine(), getLinePosition()}; }
+
         friend bool operator==(const Iterator& a, const Iterator& b);
 
         friend bool operator!=(const Iterator& a, const Iterator& b);
@@ -60,4 +69,7 @@ public:
 
 Source getSource(const std::vector<std::string>& lines, bool legacyMode);
 
+// Reads the lines of the file with the comments stripped.
+std::optional<std::vector<std::string>> readFile(const std::string& inputPath);
+
 #endif //YABFPP_SOURCE_H
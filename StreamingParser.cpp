@@ -0,0 +1,69 @@
+#include "StreamingParser.h"
+#include "parser.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace {
+
+// A run of top-level statements is split into constructs of this many, so that a long one is not held whole.
+constexpr size_t kStatementsPerConstruct = 256;
+// How many constructs the parser may get ahead of the code generation.
+constexpr size_t kQueueCapacity = 4;
+
+// Hands the constructs from the parsing thread to the consuming one, blocking the parser while it is full.
+class ConstructQueue {
+private:
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<Expr> constructs;
+    bool isClosed = false;
+public:
+    void push(Expr construct) {
+        std::unique_lock lock(mutex);
+        notFull.wait(lock, [&] { return constructs.size() < kQueueCapacity; });
+        constructs.push_back(std::move(construct));
+        notEmpty.notify_one();
+    }
+
+    // No more constructs come after close.
+    void close() {
+        std::lock_guard lock(mutex);
+        isClosed = true;
+        notEmpty.notify_one();
+    }
+
+    // std::nullopt once the queue is closed and drained.
+    std::optional<Expr> pop() {
+        std::unique_lock lock(mutex);
+        notEmpty.wait(lock, [&] { return !constructs.empty() || isClosed; });
+        if (constructs.empty())
+            return std::nullopt;
+        std::optional<Expr> construct(std::move(constructs.front()));
+        constructs.pop_front();
+        notFull.notify_one();
+        return construct;
+    }
+};
+
+}
+
+std::expected<void, std::string> parseConcurrently(const Source& src, const std::function<void(Expr)>& consume) {
+    ConstructQueue queue;
+    std::expected<void, std::string> parsed;
+    std::thread parser([&] {
+        parsed = Parser().tryParseTopLevel(src, kStatementsPerConstruct, [&](Expr construct) {
+            queue.push(std::move(construct));
+        });
+        queue.close();
+    });
+    while (auto construct = queue.pop()) {
+        consume(std::move(*construct));
+    }
+    parser.join();
+    return parsed;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <expected>
+#include <functional>
+#include <string>
+
+#include "Expr.h"
+#include "Source.h"
+
+// Parses the source on a thread of its own and hands its top-level constructs to consume on the calling thread, in
+// order, while the rest is still being parsed. The parser runs at most a few constructs ahead, so that besides the
+// source only the constructs waiting for consume are held rather than the whole AST. Returns the message of the
+// first syntax error instead, after the constructs before it are consumed.
+std::expected<void, std::string> parseConcurrently(const Source& src, const std::function<void(Expr)>& consume);
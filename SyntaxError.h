@@ -6,16 +6,12 @@
 #define YABFPP_SYNTAXERROREXCEPTION_H
 
 #include "Source.h"
-#include <cstdlib>
-#include <print>
+#include <format>
+#include <string>
 
 
-[[noreturn]] void syntaxError(auto it, std::string msg) {
-    std::println( "Syntax error at line {} at position {}. {}", 
-          std::to_string(it.getLine())
-        , std::to_string(it.getLinePosition())
-        , msg);
-    std::abort();
+inline std::string formatSyntaxError(const Source::Iterator& it, const std::string& msg) {
+    return std::format("Syntax error at line {} at position {}. {}", it.getLine(), it.getLinePosition(), msg);
 }
 
 
@@ -0,0 +1,489 @@
+#include "TieredEngine.h"
+#include "ExprAnalysis.h"
+#include "JIT.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <print>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+// The native code gets the interpreter's tape, pointer, tape size and variables by address, so the switch
+// between the tiers copies nothing.
+using CompiledLoop = void (*)(char** tape, int32_t* index, int32_t* tapeSize, char* variables);
+using CompiledFunction = char (*)(const char* arguments);
+
+// What the tier compiler needs to know about a piece of code before compiling it.
+class CodeSummary : public ExprVisitor {
+private:
+    int functionDepth = 0;
+public:
+    using ExprVisitor::visit;
+
+    std::set<std::string> callees;
+    std::vector<const BFFunctionDeclaration*> declarations;
+    bool hasReturn = false;
+
+    void visit(const LoopExpr& expr) override { expr.getBody().accept(*this); }
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            e.accept(*this);
+        }
+    }
+
+    void visit(const IfElse& expr) override {
+        expr.getIfExpr().accept(*this);
+        expr.getElseExpr().accept(*this);
+    }
+
+    void visit(const Return&) override {
+        hasReturn |= functionDepth == 0;
+    }
+
+    void visit(const BFFunctionDeclaration& expr) override {
+        declarations.push_back(&expr);
+        functionDepth++;
+        expr.getBody().accept(*this);
+        functionDepth--;
+    }
+
+    void visit(const BFFunctionCall& expr) override {
+        callees.insert(expr.getFunctionName());
+    }
+};
+
+struct LoopProfile {
+    int backEdges = 0;
+    std::atomic<CompiledLoop> compiled = nullptr;
+};
+
+struct FunctionProfile {
+    const BFFunctionDeclaration* declaration = nullptr;
+    ScopeLayout layout;
+    int calls = 0;
+    std::atomic<CompiledFunction> compiled = nullptr;
+};
+
+struct CompileJob {
+    // The functions the code calls, each one after its own callees. For a function job the hot function is the last.
+    std::vector<const BFFunctionDeclaration*> functions;
+    const LoopExpr* loop;
+    std::vector<std::string> variables;
+    std::atomic<CompiledLoop>* compiledLoop;
+    std::atomic<CompiledFunction>* compiledFunction;
+};
+
+class TierCompiler {
+private:
+    std::unique_ptr<JIT> jit;
+    std::string targetTriple;
+    int initialTapeSize;
+
+    std::mutex mutex;
+    std::condition_variable hasJobs;
+    std::deque<CompileJob> jobs;
+    bool isStopped = false;
+    std::thread worker;
+
+    void run() {
+        while (true) {
+            std::unique_lock lock(mutex);
+            hasJobs.wait(lock, [this] { return isStopped || !jobs.empty(); });
+            if (isStopped)
+                return;
+            CompileJob job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+
+            compile(job);
+        }
+    }
+
+    void generateLoopEntry(CompilerState& state, const LoopExpr& loop, const std::vector<std::string>& variables) {
+        auto& builder = state.builder;
+        auto* ptrTy = state.getPtrTy();
+        auto* mainBB = builder.GetInsertBlock();
+
+        llvm::Function* entry = state.clib.declareFunction({ptrTy, ptrTy, ptrTy, ptrTy},
+                                                           builder.getVoidTy(),
+                                                           false,
+                                                           "tier.loop");
+        state.pushFunctionStack(entry);
+        state.pushVariableHandlerStack();
+        builder.SetInsertPoint(state.createBasicBlock("tier.loop", entry));
+
+        auto args = entry->args().begin();
+        BFMachine bfMachine({ptrTy, args}, {builder.getInt32Ty(), args + 1}, {builder.getInt32Ty(), args + 2},
+                            &state, initialTapeSize);
+        for (size_t slot = 0; slot < variables.size(); slot++) {
+            auto variablePtr = builder.CreateConstGEP1_32(builder.getInt8Ty(), args + 3, slot);
+            state.getVariableHandler().setVariablePtr(variables[slot], variablePtr);
+        }
+
+        loop.generate(bfMachine);
+        builder.CreateRetVoid();
+
+        state.popVariableHandlerStack();
+        state.popFunctionStack();
+        builder.SetInsertPoint(mainBB);
+    }
+
+    void generateFunctionEntry(CompilerState& state, const BFFunctionDeclaration& declaration) {
+        auto& builder = state.builder;
+        auto* mainBB = builder.GetInsertBlock();
+
+        llvm::Function* entry = state.clib.declareFunction({state.getPtrTy()},
+                                                           builder.getInt8Ty(),
+                                                           false,
+                                                           "tier.function");
+        builder.SetInsertPoint(state.createBasicBlock("tier.function", entry));
+
+        std::vector<llvm::Value*> arguments;
+        for (size_t i = 0; i < declaration.getArgumentNames().size(); i++) {
+            auto argumentPtr = builder.CreateConstGEP1_32(builder.getInt8Ty(), entry->getArg(0), i);
+            arguments.push_back(builder.CreateLoad(Pointer{builder.getInt8Ty(), argumentPtr}));
+        }
+        auto function = state.module.getFunction(declaration.getFunctionName());
+        builder.CreateRet(builder.CreateCall(function, arguments));
+
+        builder.SetInsertPoint(mainBB);
+    }
+
+    void compile(const CompileJob& job) {
+        auto state = initCompilerState("tier", targetTriple);
+        BFMachine mainBFMachine = createBFMachine(state.get(), initialTapeSize);
+
+        for (const auto* function : job.functions) {
+            if (state->module.getFunction(function->getFunctionName()) == nullptr) {
+                function->generate(mainBFMachine);
+            }
+        }
+
+        if (job.loop != nullptr) {
+            generateLoopEntry(*state, *job.loop, job.variables);
+        } else {
+            generateFunctionEntry(*state, *job.functions.back());
+        }
+        state->finalize();
+
+        auto address = jit->addAndLookup(*state, job.loop != nullptr ? "tier.loop" : "tier.function");
+        if (!address) {
+            // The interpreter simply keeps running the code.
+            llvm::consumeError(address.takeError());
+            return;
+        }
+
+        if (job.loop != nullptr) {
+            job.compiledLoop->store(address->toPtr<CompiledLoop>(), std::memory_order_release);
+        } else {
+            job.compiledFunction->store(address->toPtr<CompiledFunction>(), std::memory_order_release);
+        }
+    }
+
+public:
+    TierCompiler(std::unique_ptr<JIT> jit, std::string targetTriple, int initialTapeSize)
+        : jit(std::move(jit)),
+          targetTriple(std::move(targetTriple)),
+          initialTapeSize(initialTapeSize),
+          worker(&TierCompiler::run, this) {}
+
+    ~TierCompiler() {
+        stop();
+    }
+
+    // Drops the jobs not started yet and waits for the one in progress.
+    void stop() {
+        {
+            std::lock_guard lock(mutex);
+            isStopped = true;
+        }
+        hasJobs.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void enqueue(CompileJob job) {
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        hasJobs.notify_one();
+    }
+};
+
+struct Frame {
+    char* tape;
+    int32_t index;
+    int32_t tapeSize;
+    std::vector<char> variables;
+    const ScopeLayout* layout;
+    bool hasReturned = false;
+};
+
+class TieredInterpreter : public ExprVisitor {
+private:
+    TierCompiler& compiler;
+    int initialTapeSize;
+    TierUpThresholds thresholds;
+    std::unordered_map<const LoopExpr*, LoopProfile> loops;
+    std::unordered_map<std::string, FunctionProfile> functions;
+    Frame* frame = nullptr;
+    char value = 0;
+
+    Frame createFrame(const ScopeLayout& layout) const {
+        return {static_cast<char*>(std::calloc(initialTapeSize, 1)),
+                0,
+                initialTapeSize,
+                std::vector<char>(layout.names.size()),
+                &layout};
+    }
+
+    char evaluate(const Int8Expr& expr) {
+        expr.accept(*this);
+        return value;
+    }
+
+    char& cellAt(int32_t index) const {
+        return frame->tape[index];
+    }
+
+    char& currentCell() const {
+        return cellAt(frame->index);
+    }
+
+    char& variable(const std::string& name) const {
+        return frame->variables[frame->layout->slots.at(name)];
+    }
+
+    // Follows doubleTapeIfNeeded, since the native code may grow the very same tape.
+    void growTapeIfNeeded(int32_t index) const {
+        if (static_cast<uint32_t>(index) < static_cast<uint32_t>(frame->tapeSize))
+            return;
+        int32_t newTapeSize = std::max(frame->tapeSize * 2, index + 1);
+        auto* newTape = static_cast<char*>(std::realloc(frame->tape, newTapeSize));
+        std::memset(newTape + frame->tapeSize, 0, newTapeSize - frame->tapeSize);
+        frame->tape = newTape;
+        frame->tapeSize = newTapeSize;
+    }
+
+    void collectFunctions(const std::string& name, std::set<std::string>& visited,
+                          std::vector<const BFFunctionDeclaration*>& result) const {
+        if (!visited.insert(name).second)
+            return;
+        const auto* declaration = functions.at(name).declaration;
+        CodeSummary summary;
+        declaration->getBody().accept(summary);
+        for (const auto& callee : summary.callees) {
+            collectFunctions(callee, visited, result);
+        }
+        result.push_back(declaration);
+    }
+
+    std::vector<const BFFunctionDeclaration*> collectFunctions(const std::set<std::string>& names) const {
+        std::set<std::string> visited;
+        std::vector<const BFFunctionDeclaration*> result;
+        for (const auto& name : names) {
+            collectFunctions(name, visited, result);
+        }
+        return result;
+    }
+
+    void enqueueLoop(const LoopExpr& loop, LoopProfile& profile) {
+        CodeSummary summary;
+        loop.getBody().accept(summary);
+        // A return has to leave the interpreted function and a declaration has to be registered by the interpreter.
+        if (summary.hasReturn || !summary.declarations.empty())
+            return;
+        compiler.enqueue({collectFunctions(summary.callees), &loop, frame->layout->names, &profile.compiled, nullptr});
+    }
+
+    void enqueueFunction(const std::string& name, FunctionProfile& profile) {
+        compiler.enqueue({collectFunctions({name}), nullptr, {}, nullptr, &profile.compiled});
+    }
+
+    char call(const FunctionProfile& profile, const std::vector<char>& arguments) {
+        Frame callee = createFrame(profile.layout);
+        std::ranges::copy(arguments, callee.variables.begin());
+
+        Frame* caller = std::exchange(frame, &callee);
+        profile.declaration->getBody().accept(*this);
+        frame = caller;
+
+        char result = callee.tape[callee.index];
+        std::free(callee.tape);
+        return result;
+    }
+
+public:
+    using ExprVisitor::visit;
+
+    TieredInterpreter(TierCompiler& compiler, int initialTapeSize, TierUpThresholds thresholds)
+        : compiler(compiler), initialTapeSize(initialTapeSize), thresholds(thresholds) {}
+
+    void run(const Expr& program) {
+        // Functions exist from the start of the program in the compiled code as well, no matter where they are declared.
+        for (const auto* declaration : getFunctionDeclarations(program)) {
+            auto& profile = functions[declaration->getFunctionName()];
+            profile.declaration = declaration;
+            profile.layout = getScopeLayout(declaration->getArgumentNames(), declaration->getBody());
+        }
+
+        ScopeLayout layout = getScopeLayout({}, program);
+        Frame main = createFrame(layout);
+        frame = &main;
+        program.accept(*this);
+        std::free(main.tape);
+    }
+
+    void visit(const MinusInt8Expr& expr) override {
+        value = static_cast<char>(-evaluate(expr.getValue()));
+    }
+
+    void visit(const VariableInt8Expr& expr) override {
+        value = variable(expr.getName());
+    }
+
+    void visit(const ConstInt8Expr& expr) override {
+        value = expr.getValue();
+    }
+
+    void visit(const MovePtrExpr& expr) override {
+        int32_t newIndex = frame->index + static_cast<signed char>(evaluate(expr.getSteps()));
+        growTapeIfNeeded(newIndex);
+        frame->index = newIndex;
+    }
+
+    void visit(const AddExpr& expr) override {
+        char add = evaluate(expr.getAdd());
+        currentCell() = static_cast<char>(currentCell() + add);
+    }
+
+    void visit(const ReadExpr&) override {
+        int c = std::getchar();
+        currentCell() = c == EOF ? 0 : static_cast<char>(c);
+    }
+
+    void visit(const PrintExpr&) override {
+        std::putchar(currentCell());
+    }
+
+    void visit(const PrintIntExpr&) override {
+        std::printf("%d\n", static_cast<unsigned char>(currentCell()));
+    }
+
+    void visit(const LoopExpr& expr) override {
+        auto& profile = loops[&expr];
+        while (!frame->hasReturned && currentCell() != 0) {
+            if (auto compiled = profile.compiled.load(std::memory_order_acquire)) {
+                compiled(&frame->tape, &frame->index, &frame->tapeSize, frame->variables.data());
+                return;
+            }
+            // The compiled loops nested in the body rely on the check hoisted out of them.
+            if (const auto& check = expr.getBoundsCheck())
+                growTapeIfNeeded(frame->index + check->maxOffset);
+            expr.getBody().accept(*this);
+            if (++profile.backEdges == thresholds.loopBackEdges) {
+                enqueueLoop(expr, profile);
+            }
+        }
+    }
+
+    void visit(const AffineLoopExpr& expr) override {
+        int maxOffset = 0;
+        for (const auto& term : expr.getTerms()) {
+            maxOffset = std::max(maxOffset, term.offset);
+        }
+        growTapeIfNeeded(frame->index + maxOffset);
+
+        char iterations = expr.getStep() == -1 ? currentCell() : static_cast<char>(-currentCell());
+        for (const auto& term : expr.getTerms()) {
+            char coefficient = evaluate(term.coefficient);
+            char& cell = cellAt(frame->index + term.offset);
+            cell = static_cast<char>(cell + coefficient * iterations);
+        }
+        currentCell() = 0;
+    }
+
+    void visit(const ListExpr& expr) override {
+        for (const auto& e : expr.getExprs()) {
+            if (frame->hasReturned)
+                return;
+            e.accept(*this);
+        }
+    }
+
+    void visit(const WriteToVariable& expr) override {
+        variable(expr.getName()) = currentCell();
+    }
+
+    void visit(const AssignExpressionValueToTheCurrentCell& expr) override {
+        currentCell() = evaluate(expr.getValue());
+    }
+
+    void visit(const IfElse& expr) override {
+        if (currentCell() != 0) {
+            expr.getIfExpr().accept(*this);
+        } else {
+            expr.getElseExpr().accept(*this);
+        }
+    }
+
+    void visit(const Return&) override {
+        frame->hasReturned = true;
+    }
+
+    void visit(const BFFunctionDeclaration&) override {
+        // Registered before the program starts.
+    }
+
+    void visit(const BFFunctionCall& expr) override {
+        std::vector<char> arguments;
+        for (const auto& argument : expr.getArguments()) {
+            arguments.push_back(evaluate(argument));
+        }
+
+        auto& profile = functions.at(expr.getFunctionName());
+        char result;
+        if (auto compiled = profile.compiled.load(std::memory_order_acquire)) {
+            result = compiled(arguments.data());
+        } else {
+            if (++profile.calls == thresholds.functionCalls) {
+                enqueueFunction(expr.getFunctionName(), profile);
+            }
+            result = call(profile, arguments);
+        }
+        currentCell() = result;
+    }
+};
+
+}
+
+int runTiered(const Expr& program, const std::string& targetTriple, int initialTapeSize, int optLevel,
+              TierUpThresholds thresholds) {
+    auto jit = createJIT(optLevel);
+    if (!jit) {
+        std::println("JIT error: {}", llvm::toString(jit.takeError()));
+        return 1;
+    }
+
+    TierCompiler compiler(std::move(*jit), targetTriple, initialTapeSize);
+    TieredInterpreter interpreter(compiler, initialTapeSize, thresholds);
+    interpreter.run(program);
+    // The compiler must not publish into the profiles of the interpreter after it is gone.
+    compiler.stop();
+    std::fflush(stdout);
+    return 0;
+}
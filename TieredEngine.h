@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "Expr.h"
+
+// How often a loop iterates or a function is called before it is compiled.
+struct TierUpThresholds {
+    int loopBackEdges = 1000;
+    int functionCalls = 100;
+};
+
+// Starts running the program in an AST interpreter right away. Loops and functions which get hot are compiled
+// with LLVM on a background thread, and the interpreter switches to the native code at the next loop back-edge
+// or call. The native code works directly on the interpreter's tape and variables.
+int runTiered(const Expr& program, const std::string& targetTriple, int initialTapeSize, int optLevel,
+              TierUpThresholds thresholds = {});
@@ -0,0 +1,101 @@
+#include "TimeReport.h"
+#include "Expr.h"
+
+#include <algorithm>
+#include <print>
+#include <ranges>
+
+TimeReport::~TimeReport() {
+    // A group prints the timers that have run when they are destroyed.
+    phaseGroup.clear();
+    functionGroup.clear();
+}
+
+llvm::Timer& TimeReport::getFunctionTimer(const BFFunctionDeclaration& declaration) {
+    auto& timer = functions[&declaration];
+    if (timer == nullptr)
+        timer = std::make_unique<llvm::Timer>(declaration.getFunctionName(), declaration.getFunctionName(),
+                                              functionGroup);
+    return *timer;
+}
+
+std::vector<const llvm::Timer*> TimeReport::getSlowestFunctions(int count) const {
+    auto timers = functions | std::views::values
+                  | std::views::transform([](const auto& timer) -> const llvm::Timer* { return timer.get(); })
+                  | std::ranges::to<std::vector>();
+    // The name breaks the ties, so that the report does not depend on the order of the map.
+    std::ranges::sort(timers, [](const llvm::Timer* a, const llvm::Timer* b) {
+        auto aWall = a->getTotalTime().getWallTime();
+        auto bWall = b->getTotalTime().getWallTime();
+        return aWall != bWall ? aWall > bWall : a->getName() < b->getName();
+    });
+    timers.resize(std::min<size_t>(timers.size(), std::max(count, 0)));
+    return timers;
+}
+
+void TimeReport::print(int topFunctions) const {
+    std::println("Time report for {}", source);
+    std::println("{:>10} {:>10} {:>10}  {}", "wall", "user", "system", "phase");
+    for (const auto& phase : phases) {
+        const auto& time = phase.timer->getTotalTime();
+        std::println("{:>10.4f} {:>10.4f} {:>10.4f}  {}{}", time.getWallTime(), time.getUserTime(),
+                     time.getSystemTime(), std::string(2 * phase.depth, ' '), phase.name);
+    }
+
+    auto slowest = getSlowestFunctions(topFunctions);
+    if (slowest.empty())
+        return;
+    std::println("{:>10} {:>10} {:>10}  {}", "wall", "user", "system", "function");
+    for (const auto* timer : slowest) {
+        const auto& time = timer->getTotalTime();
+        std::println("{:>10.4f} {:>10.4f} {:>10.4f}  {}", time.getWallTime(), time.getUserTime(),
+                     time.getSystemTime(), timer->getName());
+    }
+}
+
+static void writeTime(llvm::json::OStream& out, const llvm::TimeRecord& time) {
+    out.attribute("wall", time.getWallTime());
+    out.attribute("user", time.getUserTime());
+    out.attribute("system", time.getSystemTime());
+}
+
+void TimeReport::writeJSON(llvm::json::OStream& out, int topFunctions) const {
+    out.object([&] {
+        out.attribute("source", source);
+        out.attributeArray("phases", [&] {
+            for (const auto& phase : phases) {
+                out.object([&] {
+                    out.attribute("name", phase.name);
+                    out.attribute("depth", phase.depth);
+                    writeTime(out, phase.timer->getTotalTime());
+                });
+            }
+        });
+        out.attributeArray("functions", [&] {
+            for (const auto* timer : getSlowestFunctions(topFunctions)) {
+                out.object([&] {
+                    out.attribute("name", timer->getName());
+                    writeTime(out, timer->getTotalTime());
+                });
+            }
+        });
+    });
+}
+
+llvm::Timer* PhaseRegion::enter(TimeReport* report, std::string_view name) {
+    if (report == nullptr)
+        return nullptr;
+    auto it = std::ranges::find(report->phases, name, &TimeReport::Phase::name);
+    if (it == report->phases.end()) {
+        report->phases.push_back({std::string(name), report->depth,
+                                  std::make_unique<llvm::Timer>(name, name, report->phaseGroup)});
+        it = std::prev(report->phases.end());
+    }
+    report->depth++;
+    return it->timer.get();
+}
+
+PhaseRegion::~PhaseRegion() {
+    if (report != nullptr)
+        report->depth--;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Timer.h"
+
+class BFFunctionDeclaration;
+
+// The timings of the compilation of a single source: the phases, nested in each other, and the code generation
+// of every BF++ function, inclusive of the functions declared in it. A phase entered more than once accumulates.
+class TimeReport {
+private:
+    struct Phase {
+        std::string name;
+        int depth;
+        std::unique_ptr<llvm::Timer> timer;
+    };
+
+    std::string source;
+    llvm::TimerGroup phaseGroup{"phases", "Compilation phases"};
+    llvm::TimerGroup functionGroup{"functions", "Code generation of the BF++ functions"};
+    // Declared after the groups, so that the timers are destroyed first.
+    std::vector<Phase> phases;
+    std::unordered_map<const BFFunctionDeclaration*, std::unique_ptr<llvm::Timer>> functions;
+    int depth = 0;
+
+    [[nodiscard]] std::vector<const llvm::Timer*> getSlowestFunctions(int count) const;
+
+    friend class PhaseRegion;
+public:
+    explicit TimeReport(std::string source) : source(std::move(source)) {}
+
+    ~TimeReport();
+
+    llvm::Timer& getFunctionTimer(const BFFunctionDeclaration& declaration);
+
+    void print(int topFunctions) const;
+
+    void writeJSON(llvm::json::OStream& out, int topFunctions) const;
+};
+
+// Times the scope it lives in as a phase nested in the phases running at the moment. Does nothing without a report.
+class PhaseRegion {
+private:
+    TimeReport* report;
+    llvm::TimeRegion region;
+
+    static llvm::Timer* enter(TimeReport* report, std::string_view name);
+public:
+    PhaseRegion(TimeReport* report, std::string_view name) : report(report), region(enter(report, name)) {}
+
+    PhaseRegion(const PhaseRegion&) = delete;
+
+    ~PhaseRegion();
+};
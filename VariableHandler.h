@@ -29,6 +29,11 @@ public:
     }
 
 
+    // Makes the variable live at the given address instead of a fresh alloca.
+    void setVariablePtr(const std::string& name, llvm::Value* ptr) {
+        variableName2Ptr[name] = ptr;
+    }
+
     llvm::Value* getVariableValue(const std::string& name) {
         return builder->CreateLoad(getVariablePtr(name));
     }
@@ -54,3 +54,156 @@ inline constexpr Source generateBFProgram(size_t length, size_t seed) {
 
     return getSource({program}, /*legacyMode=*/ false);
 }
+
+// Generates BF++ programs which use functions, variables and if/else, and which are well-formed and terminate: the
+// loops are counted or clear a cell, the functions only call the ones defined before them, and the pointer never
+// moves left of where the line it is on started. Every line of the program is a function definition or a statement,
+// except the first, which initialises the variables of the main program. Removing any other line leaves a program
+// with the same guarantees, provided it still parses.
+class BFPPProgramGenerator {
+private:
+    std::mt19937 gen;
+    std::vector<std::pair<std::string, size_t>> functions;
+    std::vector<std::string> variables;
+    bool inFunction = false;
+
+    static constexpr size_t kMaxLoopDepth = 2;
+    static constexpr int kMaxLoopIterations = 4;
+
+    int random(int from, int to) {
+        return std::uniform_int_distribution<>(from, to)(gen);
+    }
+
+    std::string operand() {
+        if (random(0, 2) == 0)
+            return variables[random(0, variables.size() - 1)];
+        return std::to_string(random(1, 9));
+    }
+
+    static std::string initialise(const std::vector<std::string>& names) {
+        std::string code;
+        for (const auto& name : names) {
+            code += "_0^" + name;
+        }
+        return code;
+    }
+
+    // Moves back to the start of a loop body or a branch, so that every iteration and both branches leave the
+    // pointer where they found it.
+    static std::string moveBack(int position, int start) {
+        return position > start ? "<" + std::to_string(position - start) : "";
+    }
+
+    std::string block(size_t length, int start, size_t depth) {
+        std::string code;
+        int position = start;
+        for (size_t i = 0; i < length; i++) {
+            code += statement(position, start, depth);
+        }
+        return code + moveBack(position, start);
+    }
+
+    std::string statement(int& position, int floor, size_t depth) {
+        switch (random(0, 13)) {
+            case 0:
+                return "+" + operand();
+            case 1:
+                return "-" + operand();
+            case 2: {
+                int steps = random(1, 4);
+                position += steps;
+                return ">" + std::to_string(steps);
+            }
+            case 3: {
+                if (position == floor)
+                    return "+";
+                int steps = random(1, position - floor);
+                position -= steps;
+                return "<" + std::to_string(steps);
+            }
+            case 4:
+                return ".";
+            case 5:
+                return "*";
+            case 6:
+                return ",";
+            case 7:
+                return "^" + variables[random(0, variables.size() - 1)];
+            case 8:
+                return "_" + operand();
+            case 9:
+                return random(0, 1) == 0 ? "[-]" : "[->+<]";
+            case 10: {
+                if (depth == kMaxLoopDepth)
+                    return "-";
+                // The counter is named after the depth, so that the body cannot store into it.
+                std::string counter = std::string("c") + static_cast<char>('a' + depth);
+                return "_" + std::to_string(random(1, kMaxLoopIterations)) + "^" + counter +
+                       "[" + block(random(1, 4), position, depth + 1) + "_" + counter + "-^" + counter + "]";
+            }
+            case 11: {
+                if (depth == kMaxLoopDepth)
+                    return "+";
+                std::string code = "{" + block(random(1, 4), position, depth + 1) + "}";
+                if (random(0, 1) == 0)
+                    code += "{" + block(random(1, 4), position, depth + 1) + "}";
+                return code;
+            }
+            case 12: {
+                if (functions.empty())
+                    return ".";
+                const auto& [name, arity] = functions[random(0, functions.size() - 1)];
+                std::string code = "$" + name + "(";
+                for (size_t i = 0; i < arity; i++) {
+                    code += (i == 0 ? "" : ",") + operand();
+                }
+                return code + ")";
+            }
+            default:
+                return inFunction && random(0, 3) == 0 ? "\\" : "*";
+        }
+    }
+
+    std::string function() {
+        std::string name = "f";
+        for (size_t n = functions.size(); ; n /= 26) {
+            name += static_cast<char>('a' + n % 26);
+            if (n < 26)
+                break;
+        }
+        std::vector<std::string> arguments = {"x", "y", "z"};
+        arguments.resize(random(0, 3));
+
+        std::string code = "@" + name + "(";
+        for (size_t i = 0; i < arguments.size(); i++) {
+            code += (i == 0 ? "" : ",") + arguments[i];
+        }
+        code += "){" + initialise({"a", "b"});
+        variables = {"a", "b"};
+        variables.insert(variables.end(), arguments.begin(), arguments.end());
+        inFunction = true;
+        code += block(random(2, 8), 0, 1) + "}";
+        inFunction = false;
+
+        functions.emplace_back(name, arguments.size());
+        return code;
+    }
+
+public:
+    explicit BFPPProgramGenerator(size_t seed) : gen(seed) {}
+
+    std::vector<std::string> generate(size_t statements) {
+        functions.clear();
+        std::vector<std::string> lines = {initialise({"a", "b", "c", "d"})};
+        int position = 0;
+        for (size_t i = 0; i < statements; i++) {
+            if (random(0, 5) == 0) {
+                lines.push_back(function());
+                continue;
+            }
+            variables = {"a", "b", "c", "d"};
+            lines.push_back(statement(position, position, 0));
+        }
+        return lines;
+    }
+};
@@ -0,0 +1,71 @@
+#include "../Bytecode.h"
+#include "../BytecodeInterpreter.h"
+#include "../CompilerState.h"
+#include "../JIT.h"
+#include "../Optimizer.h"
+#include "../parser.h"
+#include "../Source.h"
+#include "llvm/TargetParser/Host.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+
+// Every job is measured from the parsed program to its last output, so the numbers tell which backend
+// finishes a given program first.
+
+static constexpr int tapeSize = 30000;
+
+static void redirectInput(benchmark::State& state, const std::string& inputPath) {
+    state.PauseTiming();
+    std::freopen(inputPath.c_str(), "r", stdin);
+    state.ResumeTiming();
+}
+
+static void runInterpreted(benchmark::State& state, const Expr* program, const std::string& inputPath) {
+    for (auto _ : state) {
+        redirectInput(state, inputPath);
+        runBytecode(lowerToBytecode(*program), tapeSize);
+    }
+}
+
+static void runCompiled(benchmark::State& state, const Expr* program, const std::string& inputPath, int optLevel) {
+    for (auto _ : state) {
+        redirectInput(state, inputPath);
+        auto compilerState = initCompilerState("bench", llvm::sys::getDefaultTargetTriple());
+        BFMachine bfMachine = createBFMachine(compilerState.get(), tapeSize);
+        program->generate(bfMachine);
+        compilerState->finalize();
+        runWithJIT(*compilerState, optLevel);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::unique_ptr<Expr>> programs;
+    for (const auto& entry : std::filesystem::directory_iterator(YABFPP_PROGRAMS_DIR)) {
+        if (entry.path().extension() != ".bfpp")
+            continue;
+        auto lines = readFile(entry.path());
+        Parser parser;
+        programs.push_back(std::make_unique<Expr>(optimize(parser.parse(getSource(lines.value(), false)))));
+
+        const Expr* program = programs.back().get();
+        std::string name = entry.path().stem();
+        std::string inputPath = std::filesystem::path(entry.path()).replace_extension(".in");
+        benchmark::RegisterBenchmark(("interpreter/" + name).c_str(), runInterpreted, program, inputPath);
+        for (int optLevel : {0, 2}) {
+            benchmark::RegisterBenchmark(("jit-O" + std::to_string(optLevel) + "/" + name).c_str(), runCompiled,
+                                         program, inputPath, optLevel);
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    // The programs print to stdout, so the report goes to stderr.
+    std::freopen("/dev/null", "w", stdout);
+    benchmark::ConsoleReporter reporter;
+    reporter.SetOutputStream(&std::cerr);
+    reporter.SetErrorStream(&std::cerr);
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+}
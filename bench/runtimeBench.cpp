@@ -0,0 +1,207 @@
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+// Measures the generated code rather than the compiler: every program of the corpus is compiled to an executable
+// once per configuration, when its benchmark first runs, which is then run on its .in file with the output discarded. Besides the wall
+// time every run reports the instructions it retired, where perf counters are available, and its peak RSS.
+//
+// The corpus is test/programs and bench/programs. Further directories, e.g. one with the classic mandelbrot.b,
+// can be passed after the benchmark flags; .b files in them are compiled in legacy mode.
+
+namespace fs = std::filesystem;
+
+struct Configuration {
+    std::string name;
+    std::string options;
+};
+
+static const std::vector<Configuration> configurations = {
+    {"O0", "-O0"},
+    {"O2", "-O2"},
+    {"O3", "-O3"},
+    {"O2-split", "-O2 --split-module"},
+};
+
+static const fs::path workDir = fs::temp_directory_path() / "yabfpp-runtime-bench";
+
+// Returns the executable, std::nullopt if either yabfpp or clang failed. The index of the program in the corpus tells
+// apart the programs of the same name in different directories.
+static std::optional<fs::path> buildExecutable(const fs::path& source, size_t programIndex,
+                                               const Configuration& configuration) {
+    auto stem = std::format("{}-{}-{}", programIndex, source.stem().string(), configuration.name);
+    auto irPath = workDir / (stem + ".ll");
+    auto executablePath = workDir / stem;
+    auto legacy = source.extension() == ".b" ? " -l" : "";
+    auto compile = std::format("{} {}{} {} -o {}", YABFPP_BINARY, source.string(), legacy, configuration.options,
+                               irPath.string());
+    auto link = std::format("clang {} -o {}", irPath.string(), executablePath.string());
+    if (std::system(compile.c_str()) != 0 || std::system(link.c_str()) != 0)
+        return std::nullopt;
+    return executablePath;
+}
+
+// Built the first time its benchmark runs, so that only the selected benchmarks are built.
+struct LazyExecutable {
+    fs::path source;
+    size_t programIndex;
+    const Configuration* configuration;
+    std::optional<std::optional<fs::path>> executable;
+
+    const std::optional<fs::path>& get() {
+        if (!executable.has_value())
+            executable = buildExecutable(source, programIndex, *configuration);
+        return *executable;
+    }
+};
+
+#ifdef __linux__
+// Counts the instructions the process retires in user space from its exec on. Returns -1 where perf is not allowed.
+static int openInstructionCounter(pid_t pid) {
+    perf_event_attr attr{};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0));
+}
+#endif
+
+struct RunResult {
+    bool succeeded;
+    double seconds;
+    long peakRSSKiB;
+    // -1 unless counted.
+    long long instructions;
+};
+
+static RunResult runExecutable(const fs::path& executable, const fs::path& inputPath) {
+    // The child waits for the counter to be attached before it execs.
+    int ready[2];
+    if (pipe(ready) != 0)
+        return {false, 0, 0, -1};
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(ready[1]);
+        char attached;
+        if (read(ready[0], &attached, 1) != 1)
+            _exit(127);
+        int input = open(inputPath.c_str(), O_RDONLY);
+        int output = open("/dev/null", O_WRONLY);
+        if (input < 0 || output < 0)
+            _exit(127);
+        dup2(input, STDIN_FILENO);
+        dup2(output, STDOUT_FILENO);
+        execl(executable.c_str(), executable.c_str(), nullptr);
+        _exit(127);
+    }
+    close(ready[0]);
+    if (pid < 0) {
+        close(ready[1]);
+        return {false, 0, 0, -1};
+    }
+
+    int counter = -1;
+#ifdef __linux__
+    counter = openInstructionCounter(pid);
+#endif
+    // Should this fail, the child reads the end of the pipe and exits, which fails the run.
+    [[maybe_unused]] auto written = write(ready[1], "x", 1);
+    close(ready[1]);
+
+    int status;
+    rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    long long instructions = -1;
+    if (counter >= 0) {
+        if (read(counter, &instructions, sizeof(instructions)) != sizeof(instructions))
+            instructions = -1;
+        close(counter);
+    }
+    bool succeeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    // ru_maxrss is in KiB on Linux.
+    return {succeeded, elapsed.count(), usage.ru_maxrss, instructions};
+}
+
+static void runProgram(benchmark::State& state, LazyExecutable* lazyExecutable, const fs::path& inputPath) {
+    const auto& executable = lazyExecutable->get();
+    if (!executable.has_value()) {
+        state.SkipWithError("compilation failed");
+        return;
+    }
+    double instructions = 0;
+    bool countsInstructions = true;
+    double peakRSS = 0;
+    for (auto _ : state) {
+        auto result = runExecutable(*executable, inputPath);
+        if (!result.succeeded) {
+            state.SkipWithError("the program failed");
+            return;
+        }
+        state.SetIterationTime(result.seconds);
+        countsInstructions = countsInstructions && result.instructions >= 0;
+        instructions += static_cast<double>(result.instructions);
+        peakRSS += static_cast<double>(result.peakRSSKiB);
+    }
+    if (countsInstructions)
+        state.counters["instructions"] = benchmark::Counter(instructions, benchmark::Counter::kAvgIterations);
+    state.counters["peak_rss_kib"] = benchmark::Counter(peakRSS, benchmark::Counter::kAvgIterations);
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    std::vector<fs::path> corpusDirs = {YABFPP_PROGRAMS_DIR, YABFPP_BENCH_PROGRAMS_DIR};
+    for (int i = 1; i < argc; i++) {
+        corpusDirs.emplace_back(argv[i]);
+    }
+
+    fs::create_directories(workDir);
+    // Every benchmark refers to its own, so they must not move.
+    std::deque<LazyExecutable> executables;
+    size_t programIndex = 0;
+    for (const auto& dir : corpusDirs) {
+        for (const auto& entry : fs::directory_iterator(dir)) {
+            auto extension = entry.path().extension();
+            if (extension != ".bfpp" && extension != ".b")
+                continue;
+            auto inputPath = fs::path(entry.path()).replace_extension(".in");
+            if (!fs::exists(inputPath))
+                inputPath = "/dev/null";
+            for (const auto& configuration : configurations) {
+                auto name = configuration.name + "/" + entry.path().stem().string();
+                auto* executable = &executables.emplace_back(entry.path(), programIndex, &configuration);
+                benchmark::RegisterBenchmark(name.c_str(), runProgram, executable, inputPath)
+                        ->UseManualTime()
+                        ->Unit(benchmark::kMillisecond);
+            }
+            programIndex++;
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
@@ -1,39 +1,68 @@
-#include <fstream>
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 #include <print>
 #include <optional>
+#include <ranges>
+#include <string_view>
+#include <vector>
 
+#include "Bytecode.h"
+#include "BytecodeInterpreter.h"
 #include "CompilerState.h"
+#include "Driver.h"
 #include "Expr.h"
+#include "JIT.h"
+#include "Optimizer.h"
 #include "parser.h"
+#include "Profile.h"
+#include "TieredEngine.h"
 #include "Source.h"
 #include "llvm/TargetParser/Host.h"
 
 #define ARGS_NOEXCEPT
 #include "third_party/args.hxx"
 
-std::optional<std::vector<std::string>> readFile(const std::string& inputPath) {
-    const char COMMENT_SEPARATOR = ';';
-    std::ifstream input(inputPath);
-    if (!input.good())
-        return std::nullopt;
-    std::vector<std::string> program;
-    for (std::string line; getline(input, line);) {
-        program.push_back(line.substr(0, line.find(COMMENT_SEPARATOR, 0)));
-    }
-    return program;
-}
-
 
 int main(int ac, char* av[]) {
     args::ArgumentParser argsParser("YABFPP compiler.");
 
     args::HelpFlag help(argsParser, "HELP", "Show this help menu.", {'h', "help"});
-    args::Positional<std::string> inputPath(argsParser, "input-file", "Input file name");
+    args::PositionalList<std::string> inputPathList(argsParser, "input-files", "Input file names. @file stands for the names listed in the file, one per line.");
     args::ValueFlag<std::string> outputPath(argsParser, "output-file", "Output file name.", {'o', "output-file"}, "a.ll");
     args::ValueFlag<int> initialTapeSize(argsParser, "tape-size", "Initial tape size.", {'t', "tape-size"}, 30000);
+    args::ValueFlag<int> tapeGrowthFactor(argsParser, "tape-growth-factor", "How many times larger the tape becomes when the pointer leaves it.", {"tape-growth-factor"}, 2);
+    args::ValueFlag<int> tapeMinimumGrowth(argsParser, "tape-min-growth", "The fewest cells the tape grows by when the pointer leaves it.", {"tape-min-growth"}, 0);
+    args::ValueFlag<std::string> tapeLayout(argsParser, "tape", "How the tape is stored: contiguous, a single array grown when the pointer leaves it, or paged, pages of 4096 cells allocated when the program first touches them.", {"tape"}, "contiguous");
+    args::Flag noAstOptFlag(argsParser, "no-ast-opt", "Generate the program as parsed, without the AST optimisations: the loop lowering, the bounds-check hoisting, the dead-code elimination and the constant propagation.", {"no-ast-opt"}, false);
     args::Flag legacyModeFlag(argsParser, "legacy-mode", "Legacy mode switch.", {'l', "legacy-mode"}, false);
-    args::ValueFlag<std::string> targetTriple(argsParser, "target", "The target triple is a string in the format of: CPU_TYPE-VENDOR-OPERATING_SYSTEM or CPU_TYPE-VENDOR-KERNEL-OPERATING_SYSTEM.", {'t', "target"}, llvm::sys::getDefaultTargetTriple());
+    args::ValueFlag<int> optLevel(argsParser, "opt-level", "Optimization level of the LLVM pipeline: 0, 1, 2 or 3.", {'O', "opt-level"}, 0);
+    args::Flag runFlag(argsParser, "run", "Compile the program in memory and run it instead of writing the IR.", {"run"}, false);
+    args::Flag interpretFlag(argsParser, "interpret", "Run the program in the bytecode interpreter, without LLVM.", {"interpret"}, false);
+    args::Flag tieredFlag(argsParser, "tiered", "Run the program in an interpreter right away and compile its hot loops and functions in the background.", {"tiered"}, false);
+    // For the tests, which need the hot code compiled right away.
+    args::ValueFlag<int> tierUpLoops(argsParser, "tier-up-loops", "Iterations after which --tiered compiles a loop.", {"tier-up-loops"}, TierUpThresholds{}.loopBackEdges, args::Options::Hidden);
+    args::ValueFlag<int> tierUpCalls(argsParser, "tier-up-calls", "Calls after which --tiered compiles a function.", {"tier-up-calls"}, TierUpThresholds{}.functionCalls, args::Options::Hidden);
+    args::ValueFlag<std::string> cacheDir(argsParser, "cache-dir", "Serve the emitted IR from this directory when the same source was compiled with the same options before.", {"cache-dir"});
+    args::ValueFlag<int> cacheSize(argsParser, "cache-size", "Size limit of the cache directory in MiB.", {"cache-size"}, 1024);
+    args::Flag incrementalFlag(argsParser, "incremental", "Compile every function into a module of its own, cached in the cache directory, and link them.", {"incremental"}, false);
+    args::Flag splitModuleFlag(argsParser, "split-module", "Optimize the functions of the program in separate modules in parallel and link them.", {"split-module"}, false);
+    args::ValueFlag<int> jobs(argsParser, "jobs", "Number of threads compiling the input files or the partitions of the module, all the cores by default.", {'j', "jobs"}, 0);
+    args::Flag timeReportFlag(argsParser, "time-report", "Print the time every compilation phase and the slowest functions took.", {"time-report"}, false);
+    args::ValueFlag<std::string> timeReportPath(argsParser, "time-report-json", "Write the time reports to this file as JSON.", {"time-report-json"}, "");
+    args::ValueFlag<int> timeReportFunctions(argsParser, "time-report-functions", "Number of the slowest functions in the time report.", {"time-report-functions"}, 10);
+    args::Flag statsFlag(argsParser, "stats", "Print the memory every compilation phase took and the sizes of the AST and the IR.", {"stats"}, false);
+    args::Flag debugInfoFlag(argsParser, "debug-info", "Emit DWARF line tables, so that debuggers and profilers show the lines of the source.", {'g', "debug-info"}, false);
+    args::Flag instrumentFlag(argsParser, "instrument", "Make the program count the iterations of its loops, the branches it takes and the calls it makes, and write them to the profile file at exit.", {"instrument", "profile-generate"}, false);
+    args::ValueFlag<std::string> profilePath(argsParser, "profile-file", "The profile file an instrumented program writes.", {"profile-file"}, "yabfpp.profile");
+    args::Flag recordsFlag(argsParser, "records", "Run the program once per length-prefixed record of the input, on as many threads as the first argument of the executable says or as there are cores, and write the outputs framed the same way in the order of the records.", {"records"}, false);
+    args::Flag emitLibFlag(argsParser, "emit-lib", "Export the program as a thread-safe C function reading its input from a buffer and writing its output to another, declared in a header written next to the IR.", {"emit-lib"}, false);
+    args::ValueFlag<std::string> librarySymbol(argsParser, "lib-symbol", "The name of the function --emit-lib exports.", {"lib-symbol"}, "bf_run");
+    args::Flag streamFlag(argsParser, "stream", "Generate every top-level construct as soon as another thread parses it and free its AST, so that the AST of the whole program is never held. The AST passes over the whole program are skipped.", {"stream"}, false);
+    args::ValueFlag<std::string> profileUsePath(argsParser, "profile-use", "Weigh the branches and the functions by this profile, so that the optimisations favour the hot paths.", {"profile-use"});
+    args::ValueFlag<std::string> profileReportPath(argsParser, "profile-report", "Rank the hottest loops and functions of the program by this profile instead of compiling it.", {"profile-report"});
+    args::ValueFlag<int> profileReportTop(argsParser, "profile-report-top", "Number of the loops and of the functions in the profile report.", {"profile-report-top"}, 10);
+    args::ValueFlag<std::string> targetTriple(argsParser, "target", "The target triple is a string in the format of: CPU_TYPE-VENDOR-OPERATING_SYSTEM or CPU_TYPE-VENDOR-KERNEL-OPERATING_SYSTEM. Several comma-separated triples generate the IR of every target from a single parse, each written with its triple before the extension of the output file.", {'t', "target"}, llvm::sys::getDefaultTargetTriple());
 
     argsParser.ParseCLI(ac, av);
 
@@ -43,25 +72,190 @@ int main(int ac, char* av[]) {
         return 0; 
     }
 
-    if (!inputPath) {
+    auto inputPaths = expandResponseFiles(get(inputPathList));
+    if (!inputPaths.has_value()) {
+        std::println("{}", inputPaths.error());
+        return 1;
+    }
+
+    if (inputPaths->empty()) {
         std::println("fatal error: no input files");
         std::println("compilation terminated.");
         return 0;
     }
 
-    std::optional<std::vector<std::string>> program = readFile(args::get(inputPath));
+    if (profileReportPath) {
+        auto program = readFile(inputPaths->front());
+        auto profile = readProfile(get(profileReportPath));
+        if (!program.has_value() || !profile.has_value()) {
+            std::println("Cannot read {}", !program.has_value() ? inputPaths->front() : get(profileReportPath));
+            return 1;
+        }
+        printProfileReport(*profile, *program, get(profileReportTop));
+        return 0;
+    }
+
+    if (get(optLevel) < 0 || get(optLevel) > 3) {
+        std::println("-O must be 0, 1, 2 or 3");
+        return 1;
+    }
+
+    // In MiB, shifted into bytes.
+    if (get(cacheSize) < 1) {
+        std::println("--cache-size must be at least 1");
+        return 1;
+    }
+
+    if (get(tapeGrowthFactor) < 1 || get(tapeMinimumGrowth) < 0) {
+        std::println("--tape-growth-factor must be at least 1 and --tape-min-growth must not be negative");
+        return 1;
+    }
+    TapeGrowth tapeGrowth{.factor = get(tapeGrowthFactor), .minimumStep = get(tapeMinimumGrowth)};
+    if (get(tapeLayout) != "contiguous" && get(tapeLayout) != "paged") {
+        std::println("--tape must be contiguous or paged");
+        return 1;
+    }
+    TapeLayout layout = get(tapeLayout) == "paged" ? TapeLayout::Paged : TapeLayout::Contiguous;
+
+    std::vector<std::string> targetTriples;
+    for (auto triple : std::views::split(get(targetTriple), ',')) {
+        targetTriples.emplace_back(std::string_view(triple));
+    }
+    if (std::ranges::any_of(targetTriples, &std::string::empty)) {
+        std::println("--target must not list an empty triple");
+        return 1;
+    }
+    // Every target is written to a file and a cache entry named after its triple, on a thread of its own.
+    auto sortedTriples = targetTriples;
+    std::ranges::sort(sortedTriples);
+    if (std::ranges::adjacent_find(sortedTriples) != sortedTriples.end()) {
+        std::println("--target must not list a triple twice");
+        return 1;
+    }
+
+    // It is pasted into the header.
+    const auto& symbol = get(librarySymbol);
+    bool isIdentifier = !symbol.empty() && !std::isdigit(static_cast<unsigned char>(symbol.front())) &&
+                        std::ranges::all_of(symbol, [](char c) {
+                            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+                        });
+    if (!isIdentifier) {
+        std::println("--lib-symbol must be a C identifier");
+        return 1;
+    }
+
+    bool emitsIR = !get(interpretFlag) && !get(tieredFlag) && !get(runFlag);
+    if (emitsIR) {
+        CompileOptions options{
+            .targetTriples = targetTriples,
+            .tapeSize = get(initialTapeSize),
+            .tapeGrowth = tapeGrowth,
+            .tapeLayout = layout,
+            .legacyMode = get(legacyModeFlag),
+            .astOptimization = !get(noAstOptFlag),
+            .optLevel = get(optLevel),
+            .splitModule = get(splitModuleFlag),
+            .incremental = get(incrementalFlag),
+            .jobs = get(jobs),
+            .cache = std::nullopt,
+            .printTimeReport = get(timeReportFlag),
+            .timeReportPath = get(timeReportPath),
+            .timeReportFunctions = get(timeReportFunctions),
+            .printStats = get(statsFlag),
+            .debugInfo = get(debugInfoFlag),
+            .instrument = get(instrumentFlag),
+            .profilePath = get(profilePath),
+            .profileUsePath = get(profileUsePath),
+            .records = get(recordsFlag),
+            .library = get(emitLibFlag),
+            .librarySymbol = get(librarySymbol),
+            .stream = get(streamFlag),
+        };
+        if (cacheDir)
+            options.cache.emplace(get(cacheDir), static_cast<uintmax_t>(get(cacheSize)) << 20);
+
+        if (inputPaths->size() > 1) {
+            if (outputPath) {
+                std::println("-o cannot be used with several input files, each is compiled next to its source");
+                return 1;
+            }
+            if (profileUsePath) {
+                std::println("--profile-use cannot be used with several input files, a profile belongs to one program");
+                return 1;
+            }
+            return compileBatch(*inputPaths, options) == 0 ? 0 : 1;
+        }
+
+        std::vector<CompileReports> reports;
+        reports.push_back(createReports(inputPaths->front(), options));
+        auto result = compileFile(inputPaths->front(), get(outputPath), options, reports.front());
+        if (!result.has_value()) {
+            std::println("{}", result.error());
+            return 1;
+        }
+        if (!printReports(reports, options)) {
+            std::println("Cannot write {}", options.timeReportPath);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (get(recordsFlag) || get(emitLibFlag) || get(streamFlag)) {
+        std::println("--records, --emit-lib and --stream apply to the emitted IR, they cannot be used to run the program");
+        return 1;
+    }
+
+    if (get(instrumentFlag) || profilePath || profileUsePath) {
+        std::println("--instrument, --profile-file and --profile-use apply to the emitted IR, they cannot be used to run the program");
+        return 1;
+    }
+
+    if (targetTriples.size() > 1) {
+        std::println("Several targets apply to the emitted IR, a program is run for one");
+        return 1;
+    }
+
+    // The interpreters have tapes of their own.
+    if ((get(interpretFlag) || get(tieredFlag)) && layout == TapeLayout::Paged) {
+        std::println("--tape=paged applies to the compiled program, it cannot be used with --interpret or --tiered");
+        return 1;
+    }
+    if ((get(interpretFlag) || get(tieredFlag)) && (tapeGrowthFactor || tapeMinimumGrowth)) {
+        std::println("--tape-growth-factor and --tape-min-growth apply to the compiled program, they cannot be used with --interpret or --tiered");
+        return 1;
+    }
+
+    if (inputPaths->size() > 1) {
+        std::println("Only one program can be run at a time");
+        return 1;
+    }
+
+    std::optional<std::vector<std::string>> program = readFile(inputPaths->front());
     if (!program.has_value()) {
         std::println("Input file doesn't exist");
         return 1;
     }
 
-    Source src = getSource(program.value(), get(legacyModeFlag));
+    Parser parser;
+    auto expr = parser.parse(getSource(program.value(), get(legacyModeFlag)));
+    if (!get(noAstOptFlag))
+        expr = optimize(expr);
+
+    if (get(interpretFlag))
+        return runBytecode(lowerToBytecode(expr), get(initialTapeSize));
 
-    auto state = initCompilerState(get(inputPath), get(targetTriple));
+    if (get(tieredFlag)) {
+        if (get(tierUpLoops) < 1 || get(tierUpCalls) < 1) {
+            std::println("--tier-up-loops and --tier-up-calls must be at least 1");
+            return 1;
+        }
+        TierUpThresholds thresholds{.loopBackEdges = get(tierUpLoops), .functionCalls = get(tierUpCalls)};
+        return runTiered(expr, get(targetTriple), get(initialTapeSize), get(optLevel), thresholds);
+    }
+
+    auto state = initCompilerState(inputPaths->front(), get(targetTriple), tapeGrowth, layout);
     BFMachine bfMachine = createBFMachine(state.get(), initialTapeSize);
-    Parser parser;
-    auto expr = parser.parse(src);
     expr.generate(bfMachine);
-    state->finalizeAndPrintIRtoFile(get(outputPath));
-    return 0;
+    state->finalize();
+    return runWithJIT(*state, get(optLevel));
 }
@@ -3,7 +3,10 @@
 //
 
 #include <cctype>
+#include <cstdlib>
 #include <memory>
+#include <print>
+#include <utility>
 #include <vector>
 
 
@@ -13,89 +16,100 @@
 #include "SyntaxError.h"
 
 
-void checkBlockClosed(Source::Iterator& i, char expected) {
+void Parser::syntaxError(Source::Iterator& i, const std::string& msg) {
+    if (!error.has_value())
+        error = formatSyntaxError(i, msg);
+    while (!i.isEnd())
+        ++i;
+}
+
+void Parser::checkBlockClosed(Source::Iterator& i, char expected) {
     if (i.isEnd() || *i != expected) {
         std::string charAsString(1, expected);
         syntaxError(i, charAsString + " is expected.");
+        return;
     }
     ++i;
 }
 
 Expr Parser::parseExpr(Source::Iterator& i) {
     char c = *i;
+    SourceLocation location = i.getLocation();
     i++;
     switch (c) {
         case '\\':
-            return mkExpr<Return>();
+            return mkExpr<Return>(location);
         case '@':
-            return parseBFFunctionDefinition(i);
+            return parseBFFunctionDefinition(i, location);
         case '$':
-            return parseBFFunctionCall(i);
+            return parseBFFunctionCall(i, location);
         case '{':
-            return parseIfElseExpr(i);
+            return parseIfElseExpr(i, location);
         case '^':
-            return mkExpr<WriteToVariable>(parseVariableName(i));
+            return mkExpr<WriteToVariable>(parseVariableName(i), location);
         case '_':
-            return mkExpr<AssignExpressionValueToTheCurrentCell>(parseInt8Expr(i, false));
+            return mkExpr<AssignExpressionValueToTheCurrentCell>(parseInt8Expr(i, false), location);
         case '+':
         case '-':
-            return parseAddExpr(i, c);
+            return parseAddExpr(i, c, location);
         case '.':
-            return mkExpr<PrintExpr>();
+            return mkExpr<PrintExpr>(location);
         case ',':
-            return mkExpr<ReadExpr>();
+            return mkExpr<ReadExpr>(location);
         case '*':
-            return mkExpr<PrintIntExpr>();
+            return mkExpr<PrintIntExpr>(location);
         case '<':
         case '>':
-            return parseMovePtrExpr(i, c);
+            return parseMovePtrExpr(i, c, location);
         case '[':
-            return parseLoopExpr(i);
+            return parseLoopExpr(i, location);
         default:
             syntaxError(i, "Unexpected symbol.");
+            return getNoOpExpr();
     }
 }
 
-Expr Parser::parseLoopExpr(Source::Iterator& i) {
+Expr Parser::parseLoopExpr(Source::Iterator& i, SourceLocation location) {
     auto body = parse(i);
     checkBlockClosed(i, ']');
-    return mkExpr<LoopExpr>(std::move(body));
+    return mkExpr<LoopExpr>(std::move(body), location);
 }
 
-Expr Parser::parseMovePtrExpr(Source::Iterator& i, char leadingChar) {
+Expr Parser::parseMovePtrExpr(Source::Iterator& i, char leadingChar, SourceLocation location) {
     auto step = parseInt8Expr(i, true);
     if (leadingChar == '<') {
         step = mkInt8Expr<MinusInt8Expr>(std::move(step));
     }
-    return mkExpr<MovePtrExpr>(std::move(step));
+    return mkExpr<MovePtrExpr>(std::move(step), location);
 }
 
-Expr Parser::parseAddExpr(Source::Iterator& i, char leadingChar) {
+Expr Parser::parseAddExpr(Source::Iterator& i, char leadingChar, SourceLocation location) {
     auto add = parseInt8Expr(i, true);
     if (leadingChar == '-') {
         add = mkInt8Expr<MinusInt8Expr>(std::move(add));
     }
-    return mkExpr<AddExpr>(std::move(add));
+    return mkExpr<AddExpr>(std::move(add), location);
 }
 
-Expr Parser::parseIfElseExpr(Source::Iterator& i) {
+Expr Parser::parseIfElseExpr(Source::Iterator& i, SourceLocation location) {
     auto ifExpr = parse(i);
     checkBlockClosed(i, '}');
-    if (*i == '{') {
+    if (!i.isEnd() && *i == '{') {
         i++;
         auto elseExpr = parse(i);
         checkBlockClosed(i, '}');
-        return mkExpr<IfElse>(std::move(ifExpr), std::move(elseExpr));
+        return mkExpr<IfElse>(std::move(ifExpr), std::move(elseExpr), location);
     }
 
-    return mkExpr<IfElse>(std::move(ifExpr), getNoOpExpr());
+    return mkExpr<IfElse>(std::move(ifExpr), getNoOpExpr(), location);
 }
 
-Expr Parser::parseBFFunctionCall(Source::Iterator& i) {
+Expr Parser::parseBFFunctionCall(Source::Iterator& i, SourceLocation location) {
     std::string functionName = parseVariableName(i);
     auto functionIt = functionName2argNumber.find(functionName);
     if (functionIt == functionName2argNumber.end()) {
         syntaxError(i, "Function " + functionName + " is not defined");
+        return getNoOpExpr();
     }
     auto argExprs = parseCallFunctionArgumentList(i);
     if (argExprs.size() != functionIt->second) {
@@ -103,49 +117,61 @@ Expr Parser::parseBFFunctionCall(Source::Iterator& i) {
                                    "Function " + functionName + " takes " + std::to_string(functionIt->second) +
                                    " arguments, " + std::to_string(argExprs.size()) + " supplied");
     }
-    return mkExpr<BFFunctionCall>(functionName, std::move(argExprs));
+    return mkExpr<BFFunctionCall>(functionName, std::move(argExprs), location);
 }
 
-Expr Parser::parseBFFunctionDefinition(Source::Iterator& i) {
+Expr Parser::parseBFFunctionDefinition(Source::Iterator& i, SourceLocation location) {
     std::string functionName = parseVariableName(i);
     std::vector<std::string> argNames = parseFunctionArgumentList(i);
     functionName2argNumber[functionName] = argNames.size();
     checkBlockClosed(i, '{');
     auto body = parse(i);
     checkBlockClosed(i, '}');
-    return mkExpr<BFFunctionDeclaration>(functionName, argNames, std::move(body));
+    return mkExpr<BFFunctionDeclaration>(functionName, argNames, std::move(body), location);
 }
 
 std::vector<Int8Expr> Parser::parseCallFunctionArgumentList(Source::Iterator& i) {
-    if (*i != '(')
+    if (i.isEnd() || *i != '(') {
         syntaxError(i, "opening bracket expected");
+        return {};
+    }
     ++i;
     std::vector<Int8Expr> arguments;
-    while (*i != ')') {
+    while (!i.isEnd() && *i != ')') {
         arguments.emplace_back(parseInt8Expr(i, false));
-        if (*i != ',' && *i != ')') {
+        if (!i.isEnd() && *i != ',' && *i != ')') {
             syntaxError(i, "a comma, a closing bracket, variable name or an integer literal");
         }
-        if (*i == ',')
+        if (!i.isEnd() && *i == ',')
             i++;
     }
+    if (i.isEnd()) {
+        syntaxError(i, "a closing bracket expected");
+        return {};
+    }
     ++i;
     return arguments;
 }
 
 std::vector<std::string> Parser::parseFunctionArgumentList(Source::Iterator& i) {
-    if (*i != '(')
+    if (i.isEnd() || *i != '(') {
         syntaxError(i, "opening bracket expected");
+        return {};
+    }
     ++i;
     std::vector<std::string> argNames;
-    while (*i != ')') {
+    while (!i.isEnd() && *i != ')') {
         argNames.push_back(parseVariableName(i));
-        if (*i != ',' && *i != ')') {
+        if (!i.isEnd() && *i != ',' && *i != ')') {
             syntaxError(i, "a comma, a closing bracket or an alphabetic character expected");
         }
-        if (*i == ',')
+        if (!i.isEnd() && *i == ',')
             i++;
     }
+    if (i.isEnd()) {
+        syntaxError(i, "a closing bracket expected");
+        return {};
+    }
     ++i;
     return argNames;
 }
@@ -179,10 +205,53 @@ Int8Expr Parser::parseInt8Expr(Source::Iterator& i, bool defaultOneAllowed) {
         return mkInt8Expr<ConstInt8Expr>(char{1});
 
     syntaxError(i, "a variable name or an integer literal is expected");
+    return mkInt8Expr<ConstInt8Expr>(char{0});
 }
 
-Expr Parser::parse(const Source& src) {
+std::expected<Expr, std::string> Parser::tryParse(const Source& src) {
+    functionName2argNumber.clear();
+    error.reset();
+    auto i = src.begin();
+    auto expr = parse(i);
+    if (error.has_value())
+        return std::unexpected(std::move(*error));
+    return expr;
+}
+
+std::expected<void, std::string> Parser::tryParseTopLevel(const Source& src, size_t maxStatements,
+                                                          const std::function<void(Expr)>& consume) {
     functionName2argNumber.clear();
+    error.reset();
     auto i = src.begin();
-    return parse(i);
+    std::vector<Expr> statements;
+    auto consumeStatements = [&] {
+        if (!statements.empty())
+            consume(mkExpr<ListExpr>(std::exchange(statements, {})));
+    };
+    // Stops where parse does.
+    while (!i.isEnd() && *i != ']' && *i != '}') {
+        bool isDefinition = *i == '@';
+        auto expr = parseExpr(i);
+        if (error.has_value())
+            return std::unexpected(std::move(*error));
+        if (isDefinition) {
+            consumeStatements();
+            consume(std::move(expr));
+        } else {
+            statements.push_back(std::move(expr));
+            if (statements.size() >= maxStatements)
+                consumeStatements();
+        }
+    }
+    consumeStatements();
+    return {};
+}
+
+Expr Parser::parse(const Source& src) {
+    auto expr = tryParse(src);
+    if (!expr.has_value()) {
+        std::println("{}", expr.error());
+        std::abort();
+    }
+    return std::move(*expr);
 }
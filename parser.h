@@ -7,13 +7,23 @@
 
 #include "Source.h"
 #include "Expr.h"
+#include <expected>
+#include <functional>
 #include <map>
+#include <optional>
 #include <string>
 
 class Parser {
 private:
     std::map<std::string, size_t> functionName2argNumber;
 
+    std::optional<std::string> error;
+
+    // Records the first error and skips the rest of the source, so that the parsing winds up right away.
+    void syntaxError(Source::Iterator& i, const std::string& msg);
+
+    void checkBlockClosed(Source::Iterator& i, char expected);
+
     Expr parseExpr(Source::Iterator& i);
 
     template<typename P>
@@ -38,21 +48,31 @@ private:
 
     std::vector<Int8Expr> parseCallFunctionArgumentList(Source::Iterator& i);
 
-    Expr parseBFFunctionDefinition(Source::Iterator& i);
+    Expr parseBFFunctionDefinition(Source::Iterator& i, SourceLocation location);
 
-    Expr parseBFFunctionCall(Source::Iterator& i);
+    Expr parseBFFunctionCall(Source::Iterator& i, SourceLocation location);
 
-    Expr parseIfElseExpr(Source::Iterator& i);
+    Expr parseIfElseExpr(Source::Iterator& i, SourceLocation location);
 
-    Expr parseAddExpr(Source::Iterator& i, char leadingChar);
+    Expr parseAddExpr(Source::Iterator& i, char leadingChar, SourceLocation location);
 
-    Expr parseMovePtrExpr(Source::Iterator& i, char leadingChar);
+    Expr parseMovePtrExpr(Source::Iterator& i, char leadingChar, SourceLocation location);
 
-    Expr parseLoopExpr(Source::Iterator& i);
+    Expr parseLoopExpr(Source::Iterator& i, SourceLocation location);
 
 public:
 
+    // Prints the syntax error and aborts if there is one.
     Expr parse(const Source& src);
+
+    // Returns the message of the first syntax error instead.
+    std::expected<Expr, std::string> tryParse(const Source& src);
+
+    // Hands the top-level constructs to consume one at a time, as soon as each is parsed: a function definition, or
+    // a run of at most maxStatements other statements. Together they are the program tryParse returns. Nothing is
+    // consumed after the first syntax error, whose message is returned.
+    std::expected<void, std::string> tryParseTopLevel(const Source& src, size_t maxStatements,
+                                                      const std::function<void(Expr)>& consume);
 };
 
 
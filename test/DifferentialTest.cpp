@@ -0,0 +1,201 @@
+#include "../bench/BFProgramGenerator.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Compiles random BF++ programs with every backend and optimisation level, runs them on random input and checks
+// that they all print what the bytecode interpreter prints without the AST optimisations. A program which diverges
+// is minimised line by line and the reproducer is written next to the other files. Finally the run time of every
+// backend is reported relative to the unoptimised executable.
+//
+// DifferentialTest [programs] [first seed] [statements per program]
+
+namespace fs = std::filesystem;
+
+struct Backend {
+    std::string name;
+    std::string options;
+    // Whether the IR is written and built into an executable with clang, or yabfpp runs the program itself.
+    bool emitsIR;
+};
+
+// The reference runs the program as parsed, so that the AST passes the others share are checked too.
+static const std::vector<Backend> backends = {
+    {"reference", "--interpret --no-ast-opt", false},
+    {"interpret", "--interpret", false},
+    {"tiered", "--tiered", false},
+    {"jit-O0", "--run -O0", false},
+    {"jit-O2", "--run -O2", false},
+    {"O0", "-O0", true},
+    {"O1", "-O1", true},
+    {"O2", "-O2", true},
+    {"O3", "-O3", true},
+    {"O2-split", "-O2 --split-module", true},
+};
+
+static const Backend& reference = backends.front();
+static const std::string baseline = "O0";
+
+// The steps of a program are bounded by construction rather than counted: its loops run at most
+// BFPPProgramGenerator::kMaxLoopIterations times, nest at most kMaxLoopDepth deep, and its functions only call the
+// ones defined before them. A correct backend thus finishes well within the limit, which only catches the backends
+// which get it wrong, whatever the speed of the machine.
+static constexpr int kTimeoutSeconds = 20;
+static constexpr int kTapeSize = 8;
+static constexpr size_t kInputLength = 32;
+
+static const fs::path workDir = fs::temp_directory_path() / "yabfpp-differential";
+
+struct Run {
+    bool succeeded;
+    std::string output;
+    double seconds;
+};
+
+static std::string readWholeFile(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+static bool shell(const std::string& command) {
+    return std::system(command.c_str()) == 0;
+}
+
+static std::optional<Run> runBackend(const Backend& backend, const fs::path& source, const fs::path& input) {
+    auto stem = (workDir / (source.stem().string() + "-" + backend.name)).string();
+    auto program = source.string();
+    if (backend.emitsIR) {
+        if (!shell(std::format("{} {} -t {} {} -o {}.ll", YABFPP_BINARY, source.string(), kTapeSize, backend.options,
+                               stem)) || !shell(std::format("clang -w {}.ll -o {}", stem, stem)))
+            return std::nullopt;
+        program = stem;
+    } else {
+        program = std::format("{} {} -t {} {}", YABFPP_BINARY, source.string(), kTapeSize, backend.options);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool succeeded = shell(std::format("timeout {} {} < {} > {}.out 2> /dev/null", kTimeoutSeconds, program,
+                                       input.string(), stem));
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return Run{succeeded, readWholeFile(stem + ".out"), elapsed.count()};
+}
+
+static void writeLines(const fs::path& path, const std::vector<std::string>& lines) {
+    std::ofstream file(path);
+    for (const auto& line : lines) {
+        file << line << '\n';
+    }
+}
+
+// Whether the backend fails or prints something else than the reference on the program. A program which does not
+// compile, as happens when the minimisation removes a function still called, does not diverge.
+static bool diverges(const std::vector<std::string>& lines, const Backend& backend, const fs::path& input) {
+    auto source = workDir / "candidate.bfpp";
+    writeLines(source, lines);
+    auto expected = runBackend(reference, source, input);
+    if (!expected.has_value() || !expected->succeeded)
+        return false;
+    auto actual = runBackend(backend, source, input);
+    return !actual.has_value() || !actual->succeeded || actual->output != expected->output;
+}
+
+// Removes the lines the divergence does not need until every remaining line does. The first line initialises the
+// variables, so that the remaining lines do not read uninitialised ones, and stays.
+static std::vector<std::string> minimise(std::vector<std::string> lines, const Backend& backend,
+                                         const fs::path& input) {
+    for (bool removed = true; removed;) {
+        removed = false;
+        for (size_t i = lines.size() - 1; i >= 1; i--) {
+            auto candidate = lines;
+            candidate.erase(candidate.begin() + i);
+            if (diverges(candidate, backend, input)) {
+                lines = std::move(candidate);
+                removed = true;
+            }
+        }
+    }
+    return lines;
+}
+
+int main(int argc, char** argv) {
+    size_t programs = argc > 1 ? std::stoul(argv[1]) : 50;
+    size_t firstSeed = argc > 2 ? std::stoul(argv[2]) : 1;
+    size_t statements = argc > 3 ? std::stoul(argv[3]) : 60;
+
+    fs::create_directories(workDir);
+    int divergences = 0;
+    std::map<std::string, double> logRatios;
+    size_t timedPrograms = 0;
+
+    for (size_t seed = firstSeed; seed < firstSeed + programs; seed++) {
+        auto lines = BFPPProgramGenerator(seed).generate(statements);
+        auto source = workDir / std::format("program{}.bfpp", seed);
+        writeLines(source, lines);
+
+        std::mt19937 gen(seed);
+        std::string inputBytes(kInputLength, '\0');
+        for (auto& byte : inputBytes) {
+            byte = static_cast<char>(std::uniform_int_distribution<>(1, 255)(gen));
+        }
+        auto input = workDir / std::format("program{}.in", seed);
+        std::ofstream(input, std::ios::binary) << inputBytes;
+
+        std::map<std::string, Run> runs;
+        for (const auto& backend : backends) {
+            auto run = runBackend(backend, source, input);
+            runs[backend.name] = run.value_or(Run{false, "", 0});
+        }
+
+        const auto& expected = runs[reference.name];
+        if (!expected.succeeded) {
+            std::cout << std::format("seed {}: the reference {} failed on {}\n", seed, reference.name,
+                                     source.string());
+            divergences++;
+            continue;
+        }
+        bool allAgree = true;
+        for (const auto& backend : backends) {
+            const auto& run = runs[backend.name];
+            if (run.succeeded && run.output == expected.output)
+                continue;
+            allAgree = false;
+            divergences++;
+            auto reproducer = workDir / std::format("reproducer{}-{}.bfpp", seed, backend.name);
+            writeLines(reproducer, minimise(lines, backend, input));
+            std::cout << std::format("seed {}: {} {} from {}, reproducer {} with input {}\n", seed, backend.name,
+                                     run.succeeded ? "prints something else" : "fails", reference.name,
+                                     reproducer.string(), input.string());
+        }
+
+        if (allAgree) {
+            timedPrograms++;
+            for (const auto& backend : backends) {
+                logRatios[backend.name] += std::log(runs[backend.name].seconds / runs[baseline].seconds);
+            }
+        }
+    }
+
+    std::cout << std::format("{} programs, {} divergences\n", programs, divergences);
+    if (timedPrograms > 0) {
+        std::cout << std::format("run time relative to {}, geometric mean over {} programs:\n", baseline,
+                                 timedPrograms);
+        for (const auto& backend : backends) {
+            std::cout << std::format("  {:10} {:.3f}\n", backend.name,
+                                     std::exp(logRatios[backend.name] / static_cast<double>(timedPrograms)));
+        }
+    }
+    return divergences == 0 ? 0 : 1;
+}
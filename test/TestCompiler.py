@@ -1,5 +1,8 @@
 import filecmp
+import json
 import os
+import resource
+import struct
 import subprocess
 import unittest
 
@@ -44,7 +47,7 @@ class Tester(object):
     def forProgram(self, programPath):
         print(f"Testing on source {programPath}")
         pathBinary, pathExpected, pathIn, pathLL, pathNoExtension, pathOut, _ = self.getPaths(programPath)
-        sh(f"{self.binary} {programPath} -o {pathLL} {self.bfCompilerOptions}")
+        self.compile(programPath, pathLL)
         self.assertTrue(os.path.isfile(pathLL))
         sh(f"{self.llvm2targetCompiler} {pathLL} -o {pathBinary} {self.llvm2targetCompilerOptions}")
         self.assertTrue(os.path.isfile(pathBinary))
@@ -54,6 +57,9 @@ class Tester(object):
 
         self.assertTrue(self.fileComparator(pathOut, pathExpected), msg=f'{pathNoExtension} wrong output')
 
+    def compile(self, programPath, pathLL):
+        sh(f"{self.binary} {programPath} -o {pathLL} {self.bfCompilerOptions}")
+
     def getPaths(self, programPath):
         pathNoExtension = programPath[:programPath.find('.')]
         pathLL = pathNoExtension + ".ll"
@@ -76,6 +82,36 @@ class Tester(object):
                     os.remove(file)
 
 
+class BatchTester(Tester):
+    def __init__(self, programsDir, bfCompilerOptions, assertTrue, binary):
+        super().__init__(programsDir, bfCompilerOptions, "clang", "", "", assertTrue, binary,
+                         lambda e, o: filecmp.cmp(e, o, shallow=False))
+
+    # all the sources are compiled by a single process before any of them is run
+    def test(self):
+        sh(f"{self.binary} {' '.join(self.programPaths)} {self.bfCompilerOptions}")
+        super().test()
+
+    def compile(self, programPath, pathLL):
+        pass
+
+
+class RunTester(Tester):
+    def __init__(self, programsDir, bfCompilerOptions, assertTrue, binary):
+        super().__init__(programsDir, bfCompilerOptions, None, None, None, assertTrue, binary,
+                         lambda e, o: filecmp.cmp(e, o, shallow=False))
+
+    def forProgram(self, programPath):
+        print(f"Running on source {programPath}")
+        _, pathExpected, pathIn, _, pathNoExtension, pathOut, _ = self.getPaths(programPath)
+
+        with open(pathIn, "r") as fileIn, open(pathOut, "w") as fileOut:
+            subprocess.Popen(f"{self.binary} {programPath} {self.bfCompilerOptions}".split(' '),
+                             stdin=fileIn, stdout=fileOut).wait()
+
+        self.assertTrue(self.fileComparator(pathOut, pathExpected), msg=f'{pathNoExtension} wrong output')
+
+
 class TestCompiler(unittest.TestCase):
     @classmethod
     def setUpClass(self) -> None:
@@ -101,6 +137,262 @@ class TestCompiler(unittest.TestCase):
                         lambda e, o: filecmp.cmp(e, o, shallow=False))
         self.general_test(tester)
 
+    def test_modernTapeGrowth(self):
+        tester = Tester('test/programs/', '-t 1 -O2 --tape-growth-factor 3 --tape-min-growth 5', "clang", "", "",
+                        self.assertTrue, self.binary, lambda e, o: filecmp.cmp(e, o, shallow=False))
+        self.general_test(tester)
+
+    def test_modernStreamed(self):
+        tester = Tester('test/programs/', '-t 3 -O2 --stream', "clang", "", "", self.assertTrue, self.binary,
+                        lambda e, o: filecmp.cmp(e, o, shallow=False))
+        self.general_test(tester)
+
+    def test_modernPaged(self):
+        tester = Tester('test/programs/', '-t 3 -O2 --tape=paged', "clang", "", "", self.assertTrue, self.binary,
+                        lambda e, o: filecmp.cmp(e, o, shallow=False))
+        self.general_test(tester)
+
+    def test_modernPagedSparse(self):
+        # visits 2000 cells half a megabyte apart, a contiguous tape over which would not fit in the address space
+        with open("build/sparse.bfpp", "w") as source:
+            source.write("_40^a[_50^b[" + ">127" * 4128 + "_b-^b]_a-^a]>127*")
+        sh(f"{self.binary} build/sparse.bfpp -o build/sparse.ll -O2 --tape=paged")
+        sh("clang build/sparse.ll -o build/sparse")
+        limit = 512 << 20
+        run = subprocess.run(["build/sparse"], stdout=subprocess.PIPE,
+                             preexec_fn=lambda: resource.setrlimit(resource.RLIMIT_AS, (limit, limit)))
+        self.assertEqual(run.returncode, 0)
+        self.assertEqual(run.stdout, b"0\n")
+
+    def test_modernCached(self):
+        # the second pass is served from the cache
+        for _ in range(2):
+            tester = Tester('test/programs/', '-t 3 -O2 --cache-dir build/cache', "clang", "", "", self.assertTrue,
+                            self.binary, lambda e, o: filecmp.cmp(e, o, shallow=False))
+            self.general_test(tester)
+        # a hit generates nothing
+        output = subprocess.run(f"{self.binary} test/programs/bsort.bfpp -o build/bsort-cached.ll -t 3 -O2 --cache-dir build/cache --time-report".split(' '),
+                                stdout=subprocess.PIPE, text=True).stdout
+        self.assertIn("cache lookup", output)
+        self.assertNotIn("code generation", output)
+
+    def test_modernIncremental(self):
+        # the second pass is served from the cache
+        for _ in range(2):
+            tester = Tester('test/programs/', '-t 3 -O2 --incremental --cache-dir build/incremental-cache', "clang", "",
+                            "", self.assertTrue, self.binary, lambda e, o: filecmp.cmp(e, o, shallow=False))
+            self.general_test(tester)
+
+    def test_modernSplit(self):
+        tester = Tester('test/programs/', '-t 3 -O2 --split-module -j 4', "clang", "", "", self.assertTrue, self.binary,
+                        lambda e, o: filecmp.cmp(e, o, shallow=False))
+        self.general_test(tester)
+
+    def test_splitIsDeterministic(self):
+        for jobs in [1, 8]:
+            sh(f"{self.binary} test/programs/quicksort.bfpp -O2 --split-module -j {jobs} -o build/split{jobs}.ll")
+        self.assertTrue(filecmp.cmp("build/split1.ll", "build/split8.ll", shallow=False))
+
+    def test_modernDebugInfo(self):
+        tester = Tester('test/programs/', '-t 3 -O2 -g', "clang", "-g", "", self.assertTrue, self.binary,
+                        lambda e, o: filecmp.cmp(e, o, shallow=False))
+        self.general_test(tester)
+        with open("test/programs/fibrec.ll", "r") as ir:
+            text = ir.read()
+        self.assertIn('DISubprogram(name: "fib"', text)
+        self.assertIn("!DILocation(line:", text)
+
+    def test_modernBatch(self):
+        tester = BatchTester('test/programs/', '-t 3 -O2 -j 4', self.assertTrue, self.binary)
+        self.general_test(tester)
+
+    def test_timeReport(self):
+        sh(f"{self.binary} test/programs/fibrec.bfpp -O2 -o build/fibrec.ll --time-report-json build/times.json")
+        with open("build/times.json") as file:
+            report, = json.load(file)
+        self.assertIn("parsing", [phase["name"] for phase in report["phases"]])
+        self.assertIn("fib", [function["name"] for function in report["functions"]])
+
+    def test_stats(self):
+        output = subprocess.run(f"{self.binary} test/programs/fibrec.bfpp -o build/fibrec.ll --stats".split(' '),
+                                stdout=subprocess.PIPE, text=True).stdout
+        self.assertIn("BFFunctionDeclaration", output)
+        self.assertIn("doubleTapeIfNeeded call sites", output)
+        # the statistics do not change the output
+        sh(f"{self.binary} test/programs/fibrec.bfpp -o build/fibrec-nostats.ll")
+        self.assertTrue(filecmp.cmp("build/fibrec.ll", "build/fibrec-nostats.ll", shallow=False))
+
+    def test_boundsCheckHoisting(self):
+        # the moves of the balanced loop share a single check before it
+        with open("build/hoisting.bfpp", "w") as source:
+            source.write("+++[>+.>+.<<-]")
+        output = subprocess.run(f"{self.binary} build/hoisting.bfpp -t 1 -o build/hoisting.ll --stats".split(' '),
+                                stdout=subprocess.PIPE, text=True).stdout
+        self.assertRegex(output, r"\s1 doubleTapeIfNeeded call sites")
+        sh("clang build/hoisting.ll -o build/hoisting")
+        run = subprocess.run(["build/hoisting"], stdout=subprocess.PIPE)
+        self.assertEqual(run.stdout, bytes([1, 1, 2, 2, 3, 3]))
+
+    def test_deadCodeElimination(self):
+        # a loop on the fresh tape, an uncalled function, code after a return and a variable never read. f prints,
+        # so the call is left to run
+        with open("build/deadCode.bfpp", "w") as source:
+            source.write("[-.]@unused(a){_a*}@f(a){_a*\\+*}_7^unread$f(4)*")
+        output = subprocess.run(f"{self.binary} build/deadCode.bfpp -o build/deadCode.ll --stats".split(' '),
+                                stdout=subprocess.PIPE, text=True).stdout
+        self.assertRegex(output, r"\s1  dead loops entered on a zero cell removed")
+        self.assertRegex(output, r"\s1  dead functions never called removed")
+        self.assertRegex(output, r"\s[1-9]\d*  dead statements after a return removed")
+        self.assertRegex(output, r"\s1  dead writes to unread variables removed")
+        sh("clang build/deadCode.ll -o build/deadCode")
+        run = subprocess.run(["build/deadCode"], stdout=subprocess.PIPE, text=True)
+        self.assertEqual(run.stdout, "4\n4\n")
+
+    def test_constantPropagation(self):
+        # every cell and variable is known, so the additions become stores and the if/else is resolved
+        with open("build/constants.bfpp", "w") as source:
+            source.write("_65^a>_a.+.{_1*}{_2*}")
+        output = subprocess.run(f"{self.binary} build/constants.bfpp -o build/constants.ll --stats".split(' '),
+                                stdout=subprocess.PIPE, text=True).stdout
+        optimized = output.split("AST nodes optimized")[1].split("instructions")[0]
+        self.assertNotIn("AddExpr", optimized)
+        self.assertNotIn("IfElse", optimized)
+        sh("clang build/constants.ll -o build/constants")
+        run = subprocess.run(["build/constants"], stdout=subprocess.PIPE, text=True)
+        self.assertEqual(run.stdout, "AB1\n")
+
+    def test_callEvaluation(self):
+        # double does no I/O, so the call with a literal is run while compiling
+        with open("build/calls.bfpp", "w") as source:
+            source.write("@double(a){_a[->++<]>}$double(21)*")
+        output = subprocess.run(f"{self.binary} build/calls.bfpp -o build/calls.ll --stats".split(' '),
+                                stdout=subprocess.PIPE, text=True).stdout
+        optimized = output.split("AST nodes optimized")[1].split("instructions")[0]
+        self.assertNotIn("BFFunctionCall", optimized)
+        sh("clang build/calls.ll -o build/calls")
+        run = subprocess.run(["build/calls"], stdout=subprocess.PIPE, text=True)
+        self.assertEqual(run.stdout, "42\n")
+
+    def test_profileReport(self):
+        # without the AST passes fib is called at run time rather than evaluated while compiling
+        sh(f"{self.binary} test/programs/fibrec.bfpp -o build/fibrec.ll --no-ast-opt --instrument --profile-file build/fibrec.profile")
+        sh("clang build/fibrec.ll -o build/fibrec")
+        with open("test/programs/fibrec.in", "r") as fileIn:
+            subprocess.run(["build/fibrec"], stdin=fileIn, stdout=subprocess.DEVNULL)
+        output = subprocess.run(f"{self.binary} test/programs/fibrec.bfpp --profile-report build/fibrec.profile".split(' '),
+                                stdout=subprocess.PIPE, text=True).stdout
+        # fib(12) makes 465 calls, and the program computes it twice
+        functions = [line.split() for line in output.split("Hottest functions")[1].splitlines()[2:]]
+        self.assertEqual([(row[0], row[2]) for row in functions], [("930", "fib")])
+
+        # the inner loop runs 4 times per iteration of the outer one
+        with open("build/loops.bfpp", "w") as source:
+            source.write("+++[->++++[->+<]<]")
+        sh(f"{self.binary} build/loops.bfpp -o build/loops.ll --no-ast-opt --instrument --profile-file build/loops.profile")
+        sh("clang build/loops.ll -o build/loops")
+        subprocess.run(["build/loops"], stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL)
+        output = subprocess.run(f"{self.binary} build/loops.bfpp --profile-report build/loops.profile".split(' '),
+                                stdout=subprocess.PIPE, text=True).stdout
+        loops = [line.split() for line in output.split("Hottest loops")[1].split("Hottest functions")[0].splitlines()[2:]]
+        self.assertEqual([row[0] for row in loops], ["12", "3"])
+        # a run emits no IR to instrument
+        run = subprocess.run(f"{self.binary} build/loops.bfpp --run --instrument".split(' '), stdout=subprocess.PIPE,
+                             text=True)
+        self.assertEqual(run.returncode, 1)
+        self.assertIn("--instrument", run.stdout)
+
+    def test_profileUse(self):
+        sh(f"{self.binary} test/programs/fibrec.bfpp -o build/fibrec.ll --profile-generate --profile-file build/fibrec.profile")
+        sh("clang build/fibrec.ll -o build/fibrec")
+        with open("test/programs/fibrec.in", "r") as fileIn:
+            subprocess.run(["build/fibrec"], stdin=fileIn, stdout=subprocess.DEVNULL)
+        tester = Tester('test/programs/', '-O2 --profile-use build/fibrec.profile', "clang", "", "", self.assertTrue,
+                        self.binary, compareFilesUpToTrailingNewline)
+        tester.forProgram(os.path.abspath("test/programs/fibrec.bfpp"))
+        with open("test/programs/fibrec.ll", "r") as ir:
+            self.assertIn("branch_weights", ir.read())
+
+    def test_records(self):
+        inputs = [b"qwerasdfzxcv", b"", b"zyx", b"hello, records"] * 50
+        sh(f"{self.binary} test/programs/bsort.bfpp -o build/bsort.ll -O2")
+        sh("clang build/bsort.ll -o build/bsort")
+        sh(f"{self.binary} test/programs/bsort.bfpp -o build/bsort-records.ll -O2 --records")
+        sh("clang build/bsort-records.ll -o build/bsort-records -pthread")
+        records = b"".join(struct.pack("<I", len(input)) + input for input in inputs)
+        for threads in ["1", "4"]:
+            output = subprocess.run(["build/bsort-records", threads], input=records, stdout=subprocess.PIPE).stdout
+            for input in inputs:
+                expected = subprocess.run(["build/bsort"], input=input, stdout=subprocess.PIPE).stdout
+                length, = struct.unpack("<I", output[:4])
+                self.assertEqual(output[4:4 + length], expected)
+                output = output[4 + length:]
+            self.assertEqual(output, b"")
+
+    def test_library(self):
+        sh(f"{self.binary} test/programs/bsort.bfpp -o build/bsort-lib.ll -O2 --emit-lib")
+        self.assertTrue(os.path.isfile("build/bsort-lib.h"))
+        # only the entry point is exported
+        with open("build/bsort-lib.ll") as ir:
+            exported = [line for line in ir if line.startswith("define ") and "internal" not in line.split("@")[0]]
+        self.assertEqual(len(exported), 1)
+        self.assertIn("@bf_run(", exported[0])
+        sh("clang -include build/bsort-lib.h test/libraryHost.c build/bsort-lib.ll -o build/bsort-lib")
+        with open("test/programs/bsort.in", "rb") as fileIn:
+            data = fileIn.read()
+        with open("test/programs/bsort.expected", "rb") as fileExpected:
+            expected = fileExpected.read()
+        run = subprocess.run(["build/bsort-lib"], input=data, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        self.assertEqual(run.returncode, 0)
+        self.assertEqual(run.stdout, expected)
+        # an output which does not fit is cut at the capacity, and the length it needs is reported
+        run = subprocess.run(["build/bsort-lib", "5"], input=data, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        self.assertEqual(run.returncode, 1)
+        self.assertEqual(run.stdout, expected[:5])
+        self.assertEqual(int(run.stderr), len(expected))
+
+    def test_multiTarget(self):
+        # a single parse emits the IR of both targets
+        host = subprocess.run(["clang", "-print-target-triple"], stdout=subprocess.PIPE, text=True).stdout.strip()
+        sh(f"{self.binary} test/programs/bsort.bfpp -o build/bsort-targets.ll -O2 --target {host},wasm32-unknown-emscripten")
+        with open("build/bsort-targets.wasm32-unknown-emscripten.ll") as wasm:
+            self.assertIn('target triple = "wasm32-unknown-emscripten"', wasm.read())
+        sh(f"clang build/bsort-targets.{host}.ll -o build/bsort-targets")
+        with open("test/programs/bsort.in", "rb") as fileIn:
+            run = subprocess.run(["build/bsort-targets"], stdin=fileIn, stdout=subprocess.PIPE)
+        with open("test/programs/bsort.expected", "rb") as fileExpected:
+            self.assertEqual(run.stdout, fileExpected.read())
+        # the threads of a repeated triple would write the same file
+        repeated = subprocess.run(f"{self.binary} test/programs/bsort.bfpp -o build/bsort-targets.ll --target {host},{host}".split(' '),
+                                  stdout=subprocess.PIPE, text=True)
+        self.assertEqual(repeated.returncode, 1)
+        self.assertIn("twice", repeated.stdout)
+
+    def test_differential(self):
+        sh("cmake --build build --target DifferentialTest -j 20")
+        self.assertEqual(subprocess.run(["build/DifferentialTest", "20"]).returncode, 0)
+
+    def test_modernJIT(self):
+        tester = RunTester('test/programs/', '--run -t 3 -O2', self.assertTrue, self.binary)
+        self.general_test(tester)
+
+    def test_legacyJIT(self):
+        tester = RunTester('test/legacy/', '--run -t 3 -l -O2', self.assertTrue, self.binary)
+        self.general_test(tester)
+
+    def test_modernTiered(self):
+        # every loop and every function is compiled as soon as it runs, the rest of the run is in native code
+        tester = RunTester('test/programs/', '--tiered -t 3 -O2 --tier-up-loops 1 --tier-up-calls 1', self.assertTrue,
+                           self.binary)
+        self.general_test(tester)
+
+    def test_modernInterpreter(self):
+        tester = RunTester('test/programs/', '--interpret -t 3', self.assertTrue, self.binary)
+        self.general_test(tester)
+
+    def test_legacyInterpreter(self):
+        tester = RunTester('test/legacy/', '--interpret -t 3 -l', self.assertTrue, self.binary)
+        self.general_test(tester)
+
     def test_modernJS(self):
         tester = Tester('test/programs/', '-t 3 --target wasm32-unknown-emscripten', "/usr/lib/emscripten/emcc",
                         "-s EXIT_RUNTIME=1", "node ", self.assertTrue, self.binary,
@@ -0,0 +1,17 @@
+// Calls a program compiled with --emit-lib, whose header is passed with -include, on the whole stdin and writes its
+// output to stdout. The argument is the capacity of the output buffer. Exits with what bf_run returns.
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char** argv) {
+    size_t capacity = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 20;
+    size_t inputCapacity = 1 << 20;
+    uint8_t* input = malloc(inputCapacity);
+    size_t inputLength = fread(input, 1, inputCapacity, stdin);
+    uint8_t* output = malloc(capacity);
+    size_t outputLength;
+    int result = bf_run(input, inputLength, output, capacity, &outputLength);
+    fwrite(output, 1, outputLength < capacity ? outputLength : capacity, stdout);
+    fprintf(stderr, "%zu\n", outputLength);
+    return result;
+}